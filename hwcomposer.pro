@@ -1,2 +1,9 @@
 TEMPLATE = subdirs
 SUBDIRS = hwcomposer
+
+# The tests need Qt5Test, and hwc2present a device gralloc to run:
+# qmake CONFIG+=tests
+tests {
+    SUBDIRS += tests
+    tests.depends = hwcomposer
+}
@@ -18,6 +18,7 @@ HEADERS += hwcomposer_screeninfo.h
 
 SOURCES += hwcomposer_backend.cpp
 HEADERS += hwcomposer_backend.h
+HEADERS += hwcomposer_overlay.h
 
 SOURCES += hwcomposer_backend_v0.cpp
 HEADERS += hwcomposer_backend_v0.h
@@ -28,6 +29,39 @@ HEADERS += hwcomposer_backend_v10.h
 SOURCES += hwcomposer_backend_v11.cpp
 HEADERS += hwcomposer_backend_v11.h
 
+SOURCES += hwcomposer_fencemonitor.cpp
+HEADERS += hwcomposer_fencemonitor.h
+
+SOURCES += hwcomposer_presentthread.cpp
+HEADERS += hwcomposer_presentthread.h
+
+SOURCES += hwcomposer_buffercount.cpp
+HEADERS += hwcomposer_buffercount.h
+
+SOURCES += hwcomposer_vsynctimeline.cpp
+HEADERS += hwcomposer_vsynctimeline.h
+
+SOURCES += hwcomposer_vsyncnotifier.cpp
+HEADERS += hwcomposer_vsyncnotifier.h
+
+SOURCES += hwcomposer_softwarevsync.cpp
+HEADERS += hwcomposer_softwarevsync.h
+
+SOURCES += hwcomposer_framescheduler.cpp
+HEADERS += hwcomposer_framescheduler.h
+
+SOURCES += hwcomposer_fbvsync.cpp
+HEADERS += hwcomposer_fbvsync.h
+
+SOURCES += hwcomposer_probecache.cpp
+HEADERS += hwcomposer_probecache.h
+
+SOURCES += hwcomposer_startuptimeline.cpp
+HEADERS += hwcomposer_startuptimeline.h
+
+SOURCES += hwcomposer_blobcache.cpp
+HEADERS += hwcomposer_blobcache.h
+
 HEADERS += qsystrace_selector.h
 
 QT += core-private gui-private dbus
@@ -76,8 +110,8 @@ packagesExist(hwcomposer-egl) {
 qtCompileTest(hwcomposer2) {
     PKGCONFIG += libhwc2
     DEFINES += HWC_PLUGIN_HAVE_HWCOMPOSER2_API
-    SOURCES += hwcomposer_backend_v20.cpp
-    HEADERS += hwcomposer_backend_v20.h
+    SOURCES += hwcomposer_backend_v20.cpp hwcomposer_window_v20.cpp
+    HEADERS += hwcomposer_backend_v20.h hwcomposer_window_v20.h
 }
 
 # Avoid X11 header collision
@@ -87,12 +121,14 @@ SOURCES +=  $$PWD/qeglfsintegration.cpp \
             $$PWD/qeglfswindow.cpp \
             $$PWD/qeglfsbackingstore.cpp \
             $$PWD/qeglfsscreen.cpp \
+            $$PWD/qeglfspageflipper.cpp \
             $$PWD/qeglfscontext.cpp
 
 HEADERS +=  $$PWD/qeglfsintegration.h \
             $$PWD/qeglfswindow.h \
             $$PWD/qeglfsbackingstore.h \
             $$PWD/qeglfsscreen.h \
+            $$PWD/qeglfspageflipper.h \
             $$PWD/qeglfscontext.h
 
 QMAKE_LFLAGS += $$QMAKE_LFLAGS_NOUNDEF
@@ -40,8 +40,15 @@
 ****************************************************************************/
 
 #include <dlfcn.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "hwcomposer_backend.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_probecache.h"
+#include "hwcomposer_softwarevsync.h"
+#include "hwcomposer_startuptimeline.h"
+#include "qeglfswindow.h"
 #ifdef HWC_DEVICE_API_VERSION_0_1
 #include "hwcomposer_backend_v0.h"
 #endif
@@ -51,18 +58,82 @@
 #include "hwcomposer_backend_v20.h"
 #endif
 
+#include <QtCore/QObject>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QTimerEvent>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <private/qwindow_p.h>
+
+#include "qsystrace_selector.h"
 
 extern "C" void *android_dlopen(const char *filename, int flags);
 extern "C" void *android_dlsym(void *handle, const char *symbol);
 extern "C" int android_dlclose(void *handle);
 
+// How long to wait for a vsync before delivering the pending updates anyway
+static const int HWC_PLUGIN_VSYNC_TIMEOUT_MS = 50;
+
+// The timers of update delivery, the backend itself isn't a QObject
+class HwComposerBackendTimers : public QObject
+{
+public:
+    explicit HwComposerBackendTimers(HwComposerBackend *backend)
+        : m_backend(backend)
+    {
+    }
+
+    QBasicTimer vsyncTimeout;
+    QBasicTimer deliverUpdateTimeout;
+
+protected:
+    void timerEvent(QTimerEvent *e) Q_DECL_OVERRIDE
+    {
+        if (e->timerId() == vsyncTimeout.timerId()) {
+            m_backend->vsyncTimedOut();
+        } else if (e->timerId() == deliverUpdateTimeout.timerId()) {
+            deliverUpdateTimeout.stop();
+            m_backend->deliverPendingUpdates();
+        }
+    }
+
+private:
+    HwComposerBackend *m_backend;
+};
+
+static QMutex librariesMutex;
+static QWaitCondition librariesCondition;
+static bool librariesLoaded = false;
+
+void
+HwComposerBackend::markLibrariesLoaded()
+{
+    QMutexLocker locker(&librariesMutex);
+    librariesLoaded = true;
+    librariesCondition.wakeAll();
+}
+
+void
+HwComposerBackend::waitForLibraries()
+{
+    QMutexLocker locker(&librariesMutex);
+    while (!librariesLoaded)
+        librariesCondition.wait(&librariesMutex);
+}
+
 HwComposerBackend::HwComposerBackend(hw_module_t *hwc_module, void *libmsf)
     : hwc_module(hwc_module), libminisf(libmsf)
+    , m_frameScheduler(&m_vsyncTimeline)
+    , m_softwareVsync(NULL)
+    , m_vsyncSuspended(false)
+    , m_timers(new HwComposerBackendTimers(this))
 {
 }
 
 HwComposerBackend::~HwComposerBackend()
 {
+    delete m_timers;
+
     if (libminisf) {
         android_dlclose(libminisf);
     }
@@ -70,6 +141,156 @@ HwComposerBackend::~HwComposerBackend()
     // XXX: Close/free hwc_module?
 }
 
+void
+HwComposerBackend::setOverlayLayers(const QVector<HwcOverlayLayer> &layers)
+{
+    foreach (const HwcOverlayLayer &layer, layers)
+        rejectOverlayLayer(layer);
+}
+
+void
+HwComposerBackend::rejectOverlayLayer(const HwcOverlayLayer &layer)
+{
+    if (layer.acquireFenceFd != -1)
+        close(layer.acquireFenceFd);
+
+    if (layer.presented)
+        layer.presented(layer.userData, false, -1);
+}
+
+void
+HwComposerBackend::vsyncReceived(qint64 timestamp)
+{
+    if (m_timers->deliverUpdateTimeout.isActive())
+        return;
+
+    int delay = m_frameScheduler.deliveryDelay(timestamp, HwComposerFenceMonitor::now());
+    m_timers->deliverUpdateTimeout.start(delay, Qt::PreciseTimer, m_timers);
+}
+
+void
+HwComposerBackend::scheduleUpdate(QWindow *window)
+{
+    m_pendingUpdate.insert(window);
+    requestVsync();
+}
+
+void
+HwComposerBackend::requestVsync()
+{
+    // While the vsync model holds, tick from it and leave hardware vsync off
+    if (m_softwareVsync && m_softwareVsync->requestTick())
+        return;
+
+    if (m_timers->vsyncTimeout.isActive())
+        m_timers->vsyncTimeout.stop();
+    else
+        setHardwareVsyncEnabled(true);
+    m_timers->vsyncTimeout.start(HWC_PLUGIN_VSYNC_TIMEOUT_MS, m_timers);
+}
+
+void
+HwComposerBackend::vsyncTimedOut()
+{
+    setHardwareVsyncEnabled(false);
+    m_timers->vsyncTimeout.stop();
+    // When waking up, we might get here as a result of requesting vsync events
+    // before the hwc is up and running. If we're timing out while still waiting
+    // for vsync to occur, trigger the update so we don't block the UI.
+    if (!m_pendingUpdate.isEmpty())
+        deliverPendingUpdates();
+}
+
+void
+HwComposerBackend::handOverToThread(QThread *thread)
+{
+    m_timers->moveToThread(thread);
+    if (QObject *backend = object())
+        backend->moveToThread(thread);
+}
+
+void
+HwComposerBackend::deliverPendingUpdates()
+{
+    QSystraceEvent trace("graphics", "QPA::handleVsync");
+
+    if (throttleUpdates())
+        return;
+
+    QSet<QWindow *> pendingWindows = takeDueWindows();
+    if (!pendingWindows.isEmpty())
+        m_frameScheduler.updateDelivered(HwComposerFenceMonitor::now());
+    foreach (QWindow *w, pendingWindows) {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 12, 0))
+        QPlatformWindow *platformWindow = w->handle();
+        if (!platformWindow)
+            continue;
+
+        platformWindow->deliverUpdateRequest();
+#else
+        QWindowPrivate *wp = (QWindowPrivate *) QWindowPrivate::get(w);
+        wp->deliverUpdateRequest();
+#endif
+    }
+
+    // Windows capped below the display rate wait for a later vsync
+    if (!m_pendingUpdate.isEmpty() && !m_vsyncSuspended)
+        requestVsync();
+}
+
+void
+HwComposerBackend::suspendVsync()
+{
+    m_vsyncSuspended = true;
+
+    // Stop the timer so we don't end up switching vsync on after the
+    // screen has been turned off. Doing so leads to logcat errors being
+    // logged.
+    m_timers->vsyncTimeout.stop();
+    if (m_softwareVsync)
+        m_softwareVsync->cancel();
+    // The panel may come back with another vsync phase
+    m_vsyncTimeline.requestResync();
+    setHardwareVsyncEnabled(false);
+}
+
+void
+HwComposerBackend::resumeVsync()
+{
+    m_vsyncSuspended = false;
+
+    // If we have pending updates, make sure those start happening now..
+    if (!m_pendingUpdate.isEmpty()) {
+        setHardwareVsyncEnabled(true);
+        m_timers->vsyncTimeout.start(HWC_PLUGIN_VSYNC_TIMEOUT_MS, m_timers);
+    }
+}
+
+QSet<QWindow *>
+HwComposerBackend::takeDueWindows()
+{
+    qint64 period = m_vsyncTimeline.period();
+    qint64 next = m_vsyncTimeline.nextVsync(HwComposerFenceMonitor::now());
+    if (period <= 0 || next <= 0) {
+        QSet<QWindow *> due = m_pendingUpdate;
+        m_pendingUpdate.clear();
+        return due;
+    }
+
+    qint64 vsync = next - period;
+    QSet<QWindow *> due;
+    for (QSet<QWindow *>::iterator it = m_pendingUpdate.begin(); it != m_pendingUpdate.end(); ) {
+        QEglFSWindow *window = static_cast<QEglFSWindow *>((*it)->handle());
+        if (!window || window->takeUpdateSlot(vsync, period)) {
+            due.insert(*it);
+            it = m_pendingUpdate.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return due;
+}
+
 void *
 initLegacyHwComposerQuirks()
 {
@@ -100,44 +321,83 @@ initLegacyHwComposerQuirks()
     } else {
         fprintf(stderr, "libminisf is incompatible or missing. Can not possibly start the SurfaceFlinger service. If you're experiencing troubles with media try updating droidmedia (and/or this plugin).");
     }
+
+    HwComposerBackend::markLibrariesLoaded();
     return libminisf;
 }
 
+// Keep the choice for the next start, dropping display values cached for
+// another hwc
+static HwComposerBackend *
+rememberProbe(HwComposerBackend *backend, HwComposerProbeCache::Backend kind,
+              const char *id, uint32_t version)
+{
+    HwComposerProbeCache *cache = HwComposerProbeCache::instance();
+
+    HwComposerProbeCache::Entry entry;
+    if (cache->lookup(&entry) && entry.backend == kind && entry.deviceVersion == version &&
+        strncmp(entry.moduleId, id, sizeof(entry.moduleId) - 1) == 0)
+        return backend;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.backend = kind;
+    strncpy(entry.moduleId, id, sizeof(entry.moduleId) - 1);
+    entry.deviceVersion = version;
+    cache->store(entry);
+    return backend;
+}
+
 HwComposerBackend *
 HwComposerBackend::create()
 {
+    HwComposerStartupTimeline::Scope timing(HwComposerStartupTimeline::BackendCreate);
+
     hw_module_t *hwc_module = NULL;
     hw_device_t *hwc_device = NULL;
 
+    HwComposerProbeCache::Entry cached;
+    bool haveCached = HwComposerProbeCache::instance()->lookup(&cached);
+
 #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER2_API
     if (!qEnvironmentVariableIsEmpty("QT_QPA_FORCE_HWC2")) {
         // Create hwcomposer backend directly without opening hardware module
         // because on some devices loading hwc2 module twice breaks graphics
         // (The first load is in the composer android service.)
-        return new HwComposerBackend_v20(NULL, NULL);
+        return rememberProbe(new HwComposerBackend_v20(NULL, NULL),
+                             HwComposerProbeCache::Backend_v20, "forced", 0);
     }
+
+    // This build has no hwcomposer module to find, don't search again
+    if (haveCached && cached.backend == HwComposerProbeCache::Backend_v20 && !cached.moduleId[0])
+        return new HwComposerBackend_v20(NULL, NULL);
 #endif
 
     // Open hardware composer
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::ModuleOpen);
     if (hw_get_module(HWC_HARDWARE_MODULE_ID, (const hw_module_t **)(&hwc_module)) == 0) {
-        fprintf(stderr, "== hwcomposer module ==\n");
-        fprintf(stderr, " * Address: %p\n", hwc_module);
-        fprintf(stderr, " * Module API Version: %x\n", hwc_module->module_api_version);
-        fprintf(stderr, " * HAL API Version: %x\n", hwc_module->hal_api_version); /* should be zero */
-        fprintf(stderr, " * Identifier: %s\n", hwc_module->id);
-        fprintf(stderr, " * Name: %s\n", hwc_module->name);
-        fprintf(stderr, " * Author: %s\n", hwc_module->author);
-        fprintf(stderr, "== hwcomposer module ==\n");
-
         // Open hardware composer device
         HWC_PLUGIN_ASSERT_ZERO(hwc_module->methods->open(hwc_module, HWC_HARDWARE_COMPOSER, &hwc_device));
+        HwComposerStartupTimeline::end(HwComposerStartupTimeline::ModuleOpen);
 
         uint32_t version = interpreted_version(hwc_device);
 
-        fprintf(stderr, "== hwcomposer device ==\n");
-        fprintf(stderr, " * Version: %x (interpreted as %x)\n", hwc_device->version, version);
-        fprintf(stderr, " * Module: %p\n", hwc_device->module);
-        fprintf(stderr, "== hwcomposer device ==\n");
+        // The banner only says something new the first time
+        if (!haveCached || cached.deviceVersion != version ||
+            strncmp(cached.moduleId, hwc_module->id, sizeof(cached.moduleId) - 1) != 0) {
+            fprintf(stderr, "== hwcomposer module ==\n");
+            fprintf(stderr, " * Address: %p\n", hwc_module);
+            fprintf(stderr, " * Module API Version: %x\n", hwc_module->module_api_version);
+            fprintf(stderr, " * HAL API Version: %x\n", hwc_module->hal_api_version); /* should be zero */
+            fprintf(stderr, " * Identifier: %s\n", hwc_module->id);
+            fprintf(stderr, " * Name: %s\n", hwc_module->name);
+            fprintf(stderr, " * Author: %s\n", hwc_module->author);
+            fprintf(stderr, "== hwcomposer module ==\n");
+
+            fprintf(stderr, "== hwcomposer device ==\n");
+            fprintf(stderr, " * Version: %x (interpreted as %x)\n", hwc_device->version, version);
+            fprintf(stderr, " * Module: %p\n", hwc_device->module);
+            fprintf(stderr, "== hwcomposer device ==\n");
+        }
 
 #ifdef HWC_DEVICE_API_VERSION_0_1
         // Special-case for old hw adaptations that have the version encoded in
@@ -146,7 +406,8 @@ HwComposerBackend::create()
         if ((hwc_device->version == HWC_DEVICE_API_VERSION_0_1) ||
             (hwc_device->version == HWC_DEVICE_API_VERSION_0_2) ||
             (hwc_device->version == HWC_DEVICE_API_VERSION_0_3)) {
-            return new HwComposerBackend_v0(hwc_module, hwc_device, initLegacyHwComposerQuirks());
+            return rememberProbe(new HwComposerBackend_v0(hwc_module, hwc_device, initLegacyHwComposerQuirks()),
+                                 HwComposerProbeCache::Backend_v0, hwc_module->id, version);
         }
 #endif
 
@@ -156,11 +417,13 @@ HwComposerBackend::create()
             case HWC_DEVICE_API_VERSION_0_1:
             case HWC_DEVICE_API_VERSION_0_2:
             case HWC_DEVICE_API_VERSION_0_3:
-                return new HwComposerBackend_v0(hwc_module, hwc_device, initLegacyHwComposerQuirks());
+                return rememberProbe(new HwComposerBackend_v0(hwc_module, hwc_device, initLegacyHwComposerQuirks()),
+                                     HwComposerProbeCache::Backend_v0, hwc_module->id, version);
 #endif
 #ifdef HWC_DEVICE_API_VERSION_1_0
             case HWC_DEVICE_API_VERSION_1_0:
-                return new HwComposerBackend_v10(hwc_module, hwc_device, initLegacyHwComposerQuirks());
+                return rememberProbe(new HwComposerBackend_v10(hwc_module, hwc_device, initLegacyHwComposerQuirks()),
+                                     HwComposerProbeCache::Backend_v10, hwc_module->id, version);
 #endif /* HWC_DEVICE_API_VERSION_1_0 */
 #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
             case HWC_DEVICE_API_VERSION_1_1:
@@ -178,11 +441,13 @@ HwComposerBackend::create()
 #endif
                 // HWC_NUM_DISPLAY_TYPES is the actual size of the array, otherwise
                 // underrun/overruns happen
-                return new HwComposerBackend_v11(hwc_module, hwc_device, initLegacyHwComposerQuirks(), HWC_NUM_DISPLAY_TYPES);
+                return rememberProbe(new HwComposerBackend_v11(hwc_module, hwc_device, initLegacyHwComposerQuirks(), HWC_NUM_DISPLAY_TYPES),
+                                     HwComposerProbeCache::Backend_v11, hwc_module->id, version);
 #endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
 #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER2_API
             case HWC_DEVICE_API_VERSION_2_0:
-                return new HwComposerBackend_v20(NULL, NULL);
+                return rememberProbe(new HwComposerBackend_v20(NULL, NULL),
+                                     HwComposerProbeCache::Backend_v20, hwc_module->id, version);
 #endif
             default:
                 fprintf(stderr, "Unknown hwcomposer API: 0x%x/0x%x/0x%x\n",
@@ -194,11 +459,15 @@ HwComposerBackend::create()
     }
 #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER2_API
     else {
+        HwComposerStartupTimeline::end(HwComposerStartupTimeline::ModuleOpen);
+
         // Create hwc2 backend directly if opening hardware module fails
-        return new HwComposerBackend_v20(NULL, NULL);
+        return rememberProbe(new HwComposerBackend_v20(NULL, NULL),
+                             HwComposerProbeCache::Backend_v20, "", 0);
     }
 #endif
 
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::ModuleOpen);
     fprintf(stderr, "Unable to load hwcomposer module\n");
     return NULL;
 }
@@ -56,8 +56,29 @@
 #include <EGL/eglext.h>
 
 #include <qdebug.h>
+#include <qregion.h>
+#include <qvector.h>
+#include <qset.h>
+#include <qobject.h>
+
+#include "hwcomposer_overlay.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_vsynctimeline.h"
+#include "hwcomposer_vsyncnotifier.h"
+#include "hwcomposer_framescheduler.h"
 
 class QEglFSWindow;
+class QWindow;
+class QThread;
+class HwComposerSoftwareVsync;
+class HwComposerBackendTimers;
+
+// A display configuration offered by the hwc
+struct HwComposerDisplayMode {
+    int width;
+    int height;
+    float refreshRate;
+};
 
 // Evaluate "x", if it doesn't return zero, print a warning
 #define HWC_PLUGIN_EXPECT_ZERO(x) \
@@ -98,12 +119,22 @@ inline static uint32_t interpreted_version(hw_device_t *hwc_device)
 }
 
 
-class HwComposerBackend {
+class HwComposerBackend : public HwComposerVsyncNotifier::Listener {
 public:
     // Factory method to get the right hwcomposer backend version
     static HwComposerBackend *create();
     static void destroy(HwComposerBackend *backend);
 
+    // The android linker of libhybris takes no lock. Opening the hwc marks
+    // when it is done loading libraries, so that start-up can let EGL load
+    // its driver on another thread from then on.
+    static void markLibrariesLoaded();
+    static void waitForLibraries();
+
+    // Start-up creates the backend off the gui thread and then moves its
+    // QObjects over
+    void handOverToThread(QThread *thread);
+
     // Public API that needs to be implemented by a versioned backend
     virtual EGLNativeDisplayType display() = 0;
     virtual EGLNativeWindowType createWindow(int width, int height) = 0;
@@ -116,12 +147,83 @@ public:
 
     virtual bool requestUpdate(QEglFSWindow *) { return false; }
 
+    // Region of the screen changed by the next swap, empty means everything
+    virtual void setSwapDamage(const QRegion &) {}
+
+    // Overlays to show with the next swap, turned down unless overridden
+    virtual void setOverlayLayers(const QVector<HwcOverlayLayer> &layers);
+
+    // Vsyncs per frame the window is capped to, for the next swap
+    virtual void setSwapVsyncDivisor(int) {}
+
+    // Scan out a full-screen client buffer instead of the GL content. Once
+    // the display is done reading it, releaseListener gets fenceSignaled()
+    // with releaseId. False if not supported.
+    virtual bool displayBuffer(ANativeWindowBuffer *, int, HwComposerFenceMonitor::Listener *, int) { return false; }
+    // No more releases for listener, it is going away
+    virtual void cancelBufferRelease(HwComposerFenceMonitor::Listener *) {}
+
+    // Current swap chain depth of the window, 0 if unknown
+    virtual int bufferCount() { return 0; }
+
+    // Configurations of the display and the index of the active one, empty
+    // and -1 if the hwc can't tell
+    virtual QVector<HwComposerDisplayMode> displayModes() { return QVector<HwComposerDisplayMode>(); }
+    virtual int activeDisplayMode() { return -1; }
+    // Switch the display to another entry of displayModes()
+    virtual bool setActiveDisplayMode(int) { return false; }
+
+    // The backend as a QObject, NULL if it isn't one
+    virtual QObject *object() { return NULL; }
+
+    // Vsync timing of the display, fed by the backend's vsync events
+    HwComposerVsyncTimeline *vsyncTimeline() { return &m_vsyncTimeline; }
+
+    // Report an overlay as not shown and drop its acquire fence
+    static void rejectOverlayLayer(const HwcOverlayLayer &layer);
+
+    // From the vsync notifier, plans when to deliver the pending updates
+    void vsyncReceived(qint64 timestamp) Q_DECL_OVERRIDE;
+
 protected:
     HwComposerBackend(hw_module_t *hwc_module, void *libmsf);
     virtual ~HwComposerBackend();
 
+    // Update requests are delivered on vsync, the backends only switch the
+    // vsync events of the display on and off. A vsync that doesn't come
+    // within 50 ms delivers the pending updates anyway.
+    virtual void setHardwareVsyncEnabled(bool enabled) = 0;
+    // True holds delivery back, the backend calls deliverPendingUpdates()
+    // again once it lets go
+    virtual bool throttleUpdates() { return false; }
+
+    // Deliver the update of window on a coming vsync
+    void scheduleUpdate(QWindow *window);
+    void deliverPendingUpdates();
+    bool hasPendingUpdates() const { return !m_pendingUpdate.isEmpty(); }
+    // Around blanking the display, vsync is off while suspended
+    void suspendVsync();
+    void resumeVsync();
+
     hw_module_t *hwc_module;
     void *libminisf;
+    HwComposerVsyncTimeline m_vsyncTimeline;
+    HwComposerFrameScheduler m_frameScheduler;
+    // Ticks from the vsync model instead of hardware vsync, if enabled
+    HwComposerSoftwareVsync *m_softwareVsync;
+
+private:
+    friend class HwComposerBackendTimers;
+
+    void requestVsync();
+    void vsyncTimedOut();
+    // Takes the windows out of pending whose vsync divisor allows an update
+    // at the current vsync, the others stay pending for a later one
+    QSet<QWindow *> takeDueWindows();
+
+    QSet<QWindow *> m_pendingUpdate;
+    bool m_vsyncSuspended;
+    HwComposerBackendTimers *m_timers;
 };
 
 #endif /* HWCOMPOSER_BACKEND_H */
@@ -43,20 +43,35 @@
 #include <hardware/hwcomposer_defs.h>
 #ifdef HWC_DEVICE_API_VERSION_0_1
 #include "hwcomposer_backend_v0.h"
+#include "hwcomposer_fbvsync.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_startuptimeline.h"
+#include "qeglfswindow.h"
 
 HwComposerBackend_v0::HwComposerBackend_v0(hw_module_t *hwc_module, hw_device_t *hw_device, void *libminisf)
     : HwComposerBackend(hwc_module, libminisf)
     , hwc_device((hwc_composer_device_t *)hw_device)
     , hwc_layer_list(NULL)
+    , m_refreshRate(0)
+    , m_displayOff(false)
+    , m_vsyncNotifier(new HwComposerVsyncNotifier(this, this))
+    , m_fbVsync(NULL)
 {
     // Allocate hardware composer layer list
     hwc_layer_list = new hwc_layer_list_t();
     hwc_layer_list->flags = HWC_GEOMETRY_CHANGED;
     hwc_layer_list->numHwLayers = 0;
+
+    // No vsync events from the hwc here, the framebuffer provides them
+    m_vsyncTimeline.setNominalPeriod(1000000000.0 / refreshRate());
+    if (!qgetenv("QPA_HWC_WORKAROUNDS").split(',').contains("no-fb-vsync"))
+        m_fbVsync = new HwComposerFbVsync(&m_vsyncTimeline, m_vsyncNotifier);
 }
 
 HwComposerBackend_v0::~HwComposerBackend_v0()
 {
+    delete m_fbVsync;
+
     if (hwc_layer_list != NULL) {
         delete hwc_layer_list;
     }
@@ -89,36 +104,63 @@ HwComposerBackend_v0::destroyWindow(EGLNativeWindowType window)
 void
 HwComposerBackend_v0::swap(EGLNativeDisplayType display, EGLSurface surface)
 {
-    // TODO: Wait for vsync
-
+    // Paced by update delivery on vsync, see requestUpdate()
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::FirstPresent);
     HWC_PLUGIN_EXPECT_ZERO(hwc_device->prepare(hwc_device, hwc_layer_list));
     HWC_PLUGIN_EXPECT_ZERO(hwc_device->set(hwc_device, display, surface, hwc_layer_list));
+
+    m_frameScheduler.framePresented(HwComposerFenceMonitor::now());
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::FirstPresent);
 }
 
 void
 HwComposerBackend_v0::sleepDisplay(bool sleep)
 {
+    m_displayOff = sleep;
     if (sleep) {
+        suspendVsync();
         HWC_PLUGIN_EXPECT_ZERO(hwc_device->set(hwc_device, NULL, NULL, NULL));
     } else {
         hwc_layer_list->flags = HWC_GEOMETRY_CHANGED;
+        resumeVsync();
     }
 }
 
 float
 HwComposerBackend_v0::refreshRate()
 {
+    // The rate can't change on these devices, ask once
+    if (m_refreshRate > 0)
+        return m_refreshRate;
+
     int vsyncVal = 0; // in ns
 
     int res = hwc_device->query(hwc_device, HWC_VSYNC_PERIOD, &vsyncVal);
     if (res != 0 || vsyncVal == 0) {
         qWarning() << "query(HWC_VSYNC_PERIOD) failed, assuming 60 Hz";
-        return 60.0;
+        m_refreshRate = 60.0;
+        return m_refreshRate;
     }
 
-    float fps = (float)1000000000 / (float)vsyncVal;
-    qDebug("VSync: %dns, %ffps", vsyncVal, fps);
-    return fps;
+    m_refreshRate = (float)1000000000 / (float)vsyncVal;
+    qDebug("VSync: %dns, %ffps", vsyncVal, m_refreshRate);
+    return m_refreshRate;
+}
+
+bool HwComposerBackend_v0::requestUpdate(QEglFSWindow *window)
+{
+    // Without a vsync source, or with the display off, Qt times the updates
+    if (m_displayOff || !m_fbVsync || !m_fbVsync->isAvailable())
+        return false;
+
+    scheduleUpdate(window->window());
+    return true;
+}
+
+void HwComposerBackend_v0::setHardwareVsyncEnabled(bool enabled)
+{
+    if (m_fbVsync)
+        m_fbVsync->setEnabled(enabled);
 }
 #endif
 #endif
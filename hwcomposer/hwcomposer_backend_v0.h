@@ -43,9 +43,13 @@
 #define HWCOMPOSER_BACKEND_V0_H
 
 #include "hwcomposer_backend.h"
+#include "hwcomposer_vsyncnotifier.h"
 
+#include <QObject>
 
-class HwComposerBackend_v0 : public HwComposerBackend {
+class HwComposerFbVsync;
+
+class HwComposerBackend_v0 : public QObject, public HwComposerBackend {
 public:
     HwComposerBackend_v0(hw_module_t *hwc_module, hw_device_t *hw_device, void *libminisf);
     virtual ~HwComposerBackend_v0();
@@ -66,9 +70,20 @@ public:
         return false;
     }
 
+    virtual bool requestUpdate(QEglFSWindow *window) Q_DECL_OVERRIDE;
+    virtual QObject *object() Q_DECL_OVERRIDE { return this; }
+
+protected:
+    void setHardwareVsyncEnabled(bool enabled) Q_DECL_OVERRIDE;
+
 private:
     hwc_composer_device_t *hwc_device;
     hwc_layer_list_t *hwc_layer_list;
+    float m_refreshRate;
+
+    bool m_displayOff;
+    HwComposerVsyncNotifier *m_vsyncNotifier;
+    HwComposerFbVsync *m_fbVsync;
 };
 
 #endif /* HWCOMPOSER_BACKEND_V0_H */
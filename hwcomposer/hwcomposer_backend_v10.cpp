@@ -40,18 +40,21 @@
 ****************************************************************************/
 
 #include "hwcomposer_backend_v10.h"
+#include "hwcomposer_startuptimeline.h"
+#include "qeglfswindow.h"
+
+#include <QtCore/QCoreApplication>
 
 #include <inttypes.h>
 #include <unistd.h>
 
 #ifdef HWC_DEVICE_API_VERSION_1_0
 
-/* For vsync thread synchronization */
-static QMutex vsync_mutex;
-static QWaitCondition vsync_cond;
-
 static float vsyncFPS = -1;
 
+/* The procs carry no backend pointer, there is only one backend anyway */
+static HwComposerBackend_v10 *vsync_backend = NULL;
+
 const char *
 comp_type_str(int32_t type)
 {
@@ -114,12 +117,13 @@ hwcv10_proc_invalidate(const struct hwc_procs* procs)
 }
 
 void
-hwcv10_proc_vsync(const struct hwc_procs* /*procs*/, int /*disp*/, int64_t /*timestamp*/)
+hwcv10_proc_vsync(const struct hwc_procs* /*procs*/, int /*disp*/, int64_t timestamp)
 {
     //fprintf(stderr, "%s: procs=%x, disp=%d, timestamp=%.0f\n", __func__, procs, disp, (float)timestamp);
-    vsync_mutex.lock();
-    vsync_cond.wakeOne();
-    vsync_mutex.unlock();
+    if (vsync_backend) {
+        vsync_backend->vsyncTimeline()->addVsync(timestamp);
+        vsync_backend->vsyncNotifier()->notify(timestamp);
+    }
 }
 
 void
@@ -141,15 +145,23 @@ HwComposerBackend_v10::HwComposerBackend_v10(hw_module_t *hwc_module, hw_device_
     , hwc_list(NULL)
     , hwc_mList(NULL)
     , hwc_numDisplays(1) // "For HWC 1.0, numDisplays will always be one."
+    , m_displayOff(true)
+    , m_vsyncNotifier(new HwComposerVsyncNotifier(this, this))
 {
+    m_vsyncTimeline.setNominalPeriod(1000000000.0 / refreshRate());
+    vsync_backend = this;
+
+    // Vsync is only turned on while updates are pending
     hwc_device->registerProcs(hwc_device, &global_procs);
-    hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 1);
     sleepDisplay(false);
 }
 
 HwComposerBackend_v10::~HwComposerBackend_v10()
 {
+    HwComposerFenceMonitor::instance()->removeListener(this);
+
     hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 0);
+    vsync_backend = NULL;
 
     // Close the hwcomposer handle
     HWC_PLUGIN_EXPECT_ZERO(hwc_close_1(hwc_device));
@@ -223,12 +235,9 @@ HwComposerBackend_v10::swap(EGLNativeDisplayType /*display*/, EGLSurface /*surfa
 {
     HWC_PLUGIN_ASSERT_ZERO(!(hwc_list->retireFenceFd == -1));
 
-    // Wait for vsync before posting new frame
-    // or force swap if exceeding the vsync timeframe
-    vsync_mutex.lock();
-    vsync_cond.wait(&vsync_mutex, 1000/vsyncFPS);
-    vsync_mutex.unlock();
-
+    // Frames are throttled on the retire fence when updates get delivered,
+    // see throttleUpdates()
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::FirstPresent);
     hwc_list->dpy = EGL_NO_DISPLAY;
     hwc_list->sur = EGL_NO_SURFACE;
     HWC_PLUGIN_ASSERT_ZERO(hwc_device->prepare(hwc_device, hwc_numDisplays, hwc_mList));
@@ -243,22 +252,69 @@ HwComposerBackend_v10::swap(EGLNativeDisplayType /*display*/, EGLSurface /*surfa
     HWC_PLUGIN_ASSERT_ZERO(hwc_device->set(hwc_device, hwc_numDisplays, hwc_mList));
 
     if (hwc_list->retireFenceFd != -1) {
-        sync_wait(hwc_list->retireFenceFd, -1);
-        close(hwc_list->retireFenceFd);
+        // Without the monitor, block to keep one frame in flight
+        if (!HwComposerFenceMonitor::instance()->watch(hwc_list->retireFenceFd, this)) {
+            sync_wait(hwc_list->retireFenceFd, -1);
+            close(hwc_list->retireFenceFd);
+        }
         hwc_list->retireFenceFd = -1;
     }
+
+    m_frameScheduler.framePresented(HwComposerFenceMonitor::now());
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::FirstPresent);
+}
+
+void
+HwComposerBackend_v10::fenceSignaled(int /*id*/, qint64 timestamp)
+{
+    HwComposerStartupTimeline::mark(HwComposerStartupTimeline::FirstPresentFence, timestamp);
+
+    // Only wake up the GUI thread if an update is held back by this fence
+    if (m_waitingForFence.testAndSetOrdered(1, 0))
+        QCoreApplication::postEvent(this, new QEvent(FenceSignaledEvent));
+}
+
+bool HwComposerBackend_v10::event(QEvent *e)
+{
+    if (e->type() == FenceSignaledEvent) {
+        if (hasPendingUpdates())
+            deliverPendingUpdates();
+        return true;
+    }
+    return QObject::event(e);
+}
+
+bool HwComposerBackend_v10::throttleUpdates()
+{
+    // Allow one frame in flight, like the wait for the previous retire
+    // fence before prepare did. Held back updates are delivered from
+    // event() once the retire fence signals.
+    HwComposerFenceMonitor *monitor = HwComposerFenceMonitor::instance();
+    if (monitor->pendingCount(this) <= 1)
+        return false;
+
+    m_waitingForFence.storeRelease(1);
+
+    // The fence may have signaled before we raised the flag
+    if (monitor->pendingCount(this) > 1)
+        return true;
+
+    m_waitingForFence.storeRelease(0);
+    return false;
 }
 
 void
 HwComposerBackend_v10::sleepDisplay(bool sleep)
 {
+    m_displayOff = sleep;
     if (sleep) {
-        HWC_PLUGIN_EXPECT_ZERO(hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 0));
+        HwComposerFenceMonitor::instance()->removeListener(this);
+        suspendVsync();
         HWC_PLUGIN_EXPECT_ZERO(hwc_device->blank(hwc_device, 0, 1));
     }
     else {
         HWC_PLUGIN_EXPECT_ZERO(hwc_device->blank(hwc_device, 0, 0));
-        HWC_PLUGIN_EXPECT_ZERO(hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 1));
+        resumeVsync();
     }
 
     if (!sleep && hwc_list != NULL) {
@@ -284,4 +340,19 @@ HwComposerBackend_v10::refreshRate()
     return vsyncFPS;
 }
 
+bool HwComposerBackend_v10::requestUpdate(QEglFSWindow *window)
+{
+    // If the display is off, do updates via the normal Qt-based timer.
+    if (m_displayOff)
+        return false;
+
+    scheduleUpdate(window->window());
+    return true;
+}
+
+void HwComposerBackend_v10::setHardwareVsyncEnabled(bool enabled)
+{
+    hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, enabled ? 1 : 0);
+}
+
 #endif /* HWC_DEVICE_API_VERSION_1_0 */
@@ -43,13 +43,16 @@
 #define HWCOMPOSER_BACKEND_V10_H
 
 #include "hwcomposer_backend.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_vsyncnotifier.h"
 
 #ifdef HWC_DEVICE_API_VERSION_1_0
 
-#include <QWaitCondition>
-#include <QMutex>
+#include <QObject>
+#include <QAtomicInt>
+#include <QEvent>
 
-class HwComposerBackend_v10 : public HwComposerBackend {
+class HwComposerBackend_v10 : public QObject, public HwComposerBackend, public HwComposerFenceMonitor::Listener {
 public:
     HwComposerBackend_v10(hw_module_t *hwc_module, hw_device_t *hw_device, void *libminisf);
     virtual ~HwComposerBackend_v10();
@@ -70,11 +73,30 @@ public:
         return false;
     }
 
+    virtual bool requestUpdate(QEglFSWindow *window) Q_DECL_OVERRIDE;
+    virtual QObject *object() Q_DECL_OVERRIDE { return this; }
+
+    bool event(QEvent *e) Q_DECL_OVERRIDE;
+
+    virtual void fenceSignaled(int id, qint64 timestamp);
+
+    HwComposerVsyncNotifier *vsyncNotifier() const { return m_vsyncNotifier; }
+
+protected:
+    void setHardwareVsyncEnabled(bool enabled) Q_DECL_OVERRIDE;
+    bool throttleUpdates() Q_DECL_OVERRIDE;
+
 private:
+    static const QEvent::Type FenceSignaledEvent = QEvent::Type(QEvent::User + 1);
+
     hwc_composer_device_1_t *hwc_device;
     hwc_display_contents_1_t *hwc_list;
     hwc_display_contents_1_t **hwc_mList;
     int hwc_numDisplays;
+
+    bool m_displayOff;
+    HwComposerVsyncNotifier *m_vsyncNotifier;
+    QAtomicInt m_waitingForFence;
 };
 
 #endif /* HWC_DEVICE_API_VERSION_1_0 */
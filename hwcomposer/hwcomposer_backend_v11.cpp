@@ -41,12 +41,21 @@
 
 #include <android-version.h>
 #include "hwcomposer_backend_v11.h"
+#include "hwcomposer_presentthread.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_buffercount.h"
+#include "hwcomposer_probecache.h"
+#include "hwcomposer_startuptimeline.h"
 #include "qeglfswindow.h"
 
 #include <QtCore/QElapsedTimer>
 #include <QtCore/QTimerEvent>
 #include <QtCore/QCoreApplication>
-#include <private/qwindow_p.h>
+#include <QtCore/QMutex>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QWindow>
+
+#include <algorithm>
 
 #include "qsystrace_selector.h"
 
@@ -70,7 +79,7 @@ struct HwcProcs_v11 : public hwc_procs
     HwComposerBackend_v11 *backend;
 };
 
-static void hwc11_callback_vsync(const struct hwc_procs *procs, int, int64_t)
+static void hwc11_callback_vsync(const struct hwc_procs *procs, int, int64_t timestamp)
 {
     static int counter = 0;
     ++counter;
@@ -79,103 +88,402 @@ static void hwc11_callback_vsync(const struct hwc_procs *procs, int, int64_t)
     else
         QSystrace::end("graphics", "QPA::vsync", "");
 
-    QCoreApplication::postEvent(static_cast<const HwcProcs_v11 *>(procs)->backend, new QEvent(QEvent::User));
+    HwComposerBackend_v11 *backend = static_cast<const HwcProcs_v11 *>(procs)->backend;
+    backend->vsyncTimeline()->addVsync(timestamp);
+    backend->vsyncNotifier()->notify(timestamp);
 }
 
 static void hwc11_callback_invalidate(const struct hwc_procs *)
 {
 }
 
-static void hwc11_callback_hotplug(const struct hwc_procs *, int, int)
+static void hwc11_callback_hotplug(const struct hwc_procs *procs, int disp, int)
 {
+    if (disp == HWC_DISPLAY_PRIMARY)
+        static_cast<const HwcProcs_v11 *>(procs)->backend->invalidateDisplayAttributes();
 }
 
 
-class HWComposer : public HWComposerNativeWindow
+// Room for overlays in the layer list, besides the GL content layer and
+// the framebuffer target
+static const int HWC_PLUGIN_MAX_OVERLAYS = 4;
+
+// Display configs we look at, panels offer a handful at most
+static const size_t HWC_PLUGIN_MAX_CONFIGS = 32;
+
+class HWComposer : public HWComposerNativeWindow, public HwComposerPresentThread::Client
 {
     private:
-        hwc_layer_1_t *fblayer;
+        hwc_layer_1_t contentTemplate;
+        hwc_layer_1_t targetTemplate;
         hwc_composer_device_1_t *hwcdevice;
         hwc_display_contents_1_t **mlist;
         int num_displays;
         bool m_syncBeforeSet;
         bool m_waitOnRetireFence;
+        HwComposerBackend_v11 *m_backend;
+        HwComposerPresentThread *m_presentThread;
+        HwComposerBufferCountPolicy *m_bufferPolicy;
+        HwComposerFrameScheduler *m_frameScheduler;
+        QAtomicInt m_bufferCount;
+        HwComposerFrame m_nextFrame;
+        QVector<hwc_rect_t> m_damageRects;
+        QVector<QRect> m_lastOverlayFrames;
+
+        QMutex m_presentMutex;
+
+        void buildLayerList(QVector<HwcOverlayLayer> &overlays, QVector<hwc_layer_1_t *> &overlayLayers,
+                            hwc_layer_1_t **contentlayer, hwc_layer_1_t **fblayer);
+        int presentTarget(buffer_handle_t handle, int acquireFenceFd, const HwComposerFrame &frame);
     protected:
         void present(HWComposerNativeWindowBuffer *buffer);
+        int dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fenceFd);
 
     public:
 
     HWComposer(unsigned int width, unsigned int height, unsigned int format,
             hwc_composer_device_1_t *device, hwc_display_contents_1_t **mList,
-            hwc_layer_1_t *layer, int num_displays);
+            int num_displays, HwComposerBackend_v11 *backend);
+    ~HWComposer();
     void set();
+
+    void setDamage(const QRegion &damage) { m_nextFrame.damage = damage; }
+    void setOverlayLayers(const QVector<HwcOverlayLayer> &layers) { m_nextFrame.overlays = layers; }
+
+    void presentBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame) Q_DECL_OVERRIDE;
+    bool presentClientBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                             HwComposerFenceMonitor::Listener *releaseListener, int releaseId);
+    void waitForPresent();
+
+    void setVsyncPeriod(qint64 periodNs);
+    void setVsyncDivisor(int divisor);
+    void setFrameScheduler(HwComposerFrameScheduler *scheduler) { m_frameScheduler = scheduler; }
+    int bufferCount() const { return m_bufferCount.loadAcquire(); }
 };
 
 HWComposer::HWComposer(unsigned int width, unsigned int height, unsigned int format,
         hwc_composer_device_1_t *device, hwc_display_contents_1_t **mList,
-        hwc_layer_1_t *layer, int num_displays)
+        int num_displays, HwComposerBackend_v11 *backend)
     : HWComposerNativeWindow(width, height, format)
-    , fblayer(layer)
     , hwcdevice(device)
     , mlist(mList)
     , num_displays(num_displays)
+    , m_backend(backend)
+    , m_presentThread(NULL)
+    , m_bufferPolicy(NULL)
+    , m_frameScheduler(NULL)
 {
-    int bufferCount = qBound(2, qgetenv("QPA_HWC_BUFFER_COUNT").toInt(), 8);
+    // The list is rebuilt every frame around these two layers
+    contentTemplate = mlist[0]->hwLayers[0];
+    targetTemplate = mlist[0]->hwLayers[1];
+
+    int bufferCount;
+    if (HwComposerBufferCountPolicy::isAdaptive()) {
+        m_bufferPolicy = new HwComposerBufferCountPolicy;
+        bufferCount = m_bufferPolicy->bufferCount();
+    } else {
+        bufferCount = qBound(2, qgetenv("QPA_HWC_BUFFER_COUNT").toInt(), 8);
+    }
+    m_bufferCount.storeRelease(bufferCount);
     setBufferCount(bufferCount);
     m_syncBeforeSet = qEnvironmentVariableIsSet("QPA_HWC_SYNC_BEFORE_SET");
     m_waitOnRetireFence = qEnvironmentVariableIsSet("QPA_HWC_WAIT_ON_RETIRE_FENCE");
+
+    if (HwComposerPresentThread::isEnabled())
+        m_presentThread = new HwComposerPresentThread(this, m_bufferPolicy ? 2 : bufferCount - 1);
+}
+
+HWComposer::~HWComposer()
+{
+    delete m_presentThread;
+    delete m_bufferPolicy;
+}
+
+void HWComposer::setVsyncPeriod(qint64 periodNs)
+{
+    if (m_bufferPolicy)
+        m_bufferPolicy->setVsyncPeriod(periodNs);
+}
+
+void HWComposer::setVsyncDivisor(int divisor)
+{
+    if (m_bufferPolicy)
+        m_bufferPolicy->setVsyncDivisor(divisor);
 }
 
 void HWComposer::present(HWComposerNativeWindowBuffer *buffer)
+{
+    // Damage and overlays set for this swap belong to this buffer only
+    HwComposerFrame frame = m_nextFrame;
+    m_nextFrame = HwComposerFrame();
+
+    if (m_presentThread)
+        m_presentThread->queueBuffer(buffer, frame);
+    else
+        presentBuffer(buffer, frame);
+}
+
+int HWComposer::dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fenceFd)
+{
+    // The native window never hands out the front buffer (the one queued
+    // last), so once everything older than that has been presented, any
+    // buffer we can get has its release fence set.
+    if (m_presentThread)
+        m_presentThread->waitForPending(1);
+
+    if (m_bufferPolicy && m_bufferPolicy->bufferCount() != bufferCount()) {
+        // The buffers get reallocated, queued ones have to be presented first
+        waitForPresent();
+        m_bufferCount.storeRelease(m_bufferPolicy->bufferCount());
+        setBufferCount(m_bufferPolicy->bufferCount());
+    }
+
+    return HWComposerNativeWindow::dequeueBuffer(buffer, fenceFd);
+}
+
+void HWComposer::waitForPresent()
+{
+    if (m_presentThread)
+        m_presentThread->waitForPending(0);
+}
+
+static bool overlayZLessThan(const HwcOverlayLayer &a, const HwcOverlayLayer &b)
+{
+    return a.z < b.z;
+}
+
+static void initOverlayLayer(hwc_layer_1_t *layer, const HwcOverlayLayer &overlay)
+{
+    const QRect &f = overlay.displayFrame;
+    const hwc_rect_t r = { f.left(), f.top(), f.left() + f.width(), f.top() + f.height() };
+
+    memset(layer, 0, sizeof(hwc_layer_1_t));
+    // The hwc switches this to HWC_OVERLAY in prepare if it takes the layer
+    layer->compositionType = HWC_FRAMEBUFFER;
+    layer->hints = 0;
+    layer->flags = 0;
+    layer->handle = overlay.buffer->handle;
+    layer->transform = 0;
+    layer->blending = overlay.opaque ? HWC_BLENDING_NONE : HWC_BLENDING_PREMULT;
+#ifdef HWC_DEVICE_API_VERSION_1_3
+    layer->sourceCropf.top = overlay.sourceCrop.top();
+    layer->sourceCropf.left = overlay.sourceCrop.left();
+    layer->sourceCropf.bottom = overlay.sourceCrop.bottom();
+    layer->sourceCropf.right = overlay.sourceCrop.right();
+#else
+    const QRect crop = overlay.sourceCrop.toAlignedRect();
+    const hwc_rect_t c = { crop.left(), crop.top(), crop.left() + crop.width(), crop.top() + crop.height() };
+    layer->sourceCrop = c;
+#endif
+    layer->displayFrame = r;
+    layer->visibleRegionScreen.numRects = 1;
+    layer->visibleRegionScreen.rects = &layer->displayFrame;
+    layer->acquireFenceFd = overlay.acquireFenceFd;
+    layer->releaseFenceFd = -1;
+#if (ANDROID_VERSION_MAJOR >= 4) && (ANDROID_VERSION_MINOR >= 3) || (ANDROID_VERSION_MAJOR >= 5)
+    layer->planeAlpha = 0xff;
+#endif
+#ifdef HWC_DEVICE_API_VERSION_1_5
+    layer->surfaceDamage.numRects = 0;
+#endif
+}
+
+void HWComposer::buildLayerList(QVector<HwcOverlayLayer> &overlays, QVector<hwc_layer_1_t *> &overlayLayers,
+                                hwc_layer_1_t **contentlayer, hwc_layer_1_t **fblayer)
+{
+    hwc_display_contents_1_t *list = mlist[0];
+
+    std::stable_sort(overlays.begin(), overlays.end(), overlayZLessThan);
+    while (overlays.size() > HWC_PLUGIN_MAX_OVERLAYS) {
+        HwComposerBackend::rejectOverlayLayer(overlays.last());
+        overlays.removeLast();
+    }
+
+    // Overlays below the GL content, the GL content, overlays above it and
+    // finally the framebuffer target, which has to be the last layer.
+    QVector<QRect> overlayFrames;
+    size_t count = 0;
+    int i = 0;
+    for (; i < overlays.size() && overlays.at(i).z < 0; i++) {
+        overlayLayers.append(&list->hwLayers[count]);
+        overlayFrames.append(overlays.at(i).displayFrame);
+        initOverlayLayer(&list->hwLayers[count++], overlays.at(i));
+    }
+    bool haveOverlaysBelow = i > 0;
+
+    hwc_layer_1_t *content = &list->hwLayers[count++];
+    *content = contentTemplate;
+    content->visibleRegionScreen.rects = &content->displayFrame;
+
+    for (; i < overlays.size(); i++) {
+        overlayLayers.append(&list->hwLayers[count]);
+        overlayFrames.append(overlays.at(i).displayFrame);
+        initOverlayLayer(&list->hwLayers[count++], overlays.at(i));
+    }
+
+    hwc_layer_1_t *target = &list->hwLayers[count++];
+    *target = targetTemplate;
+    target->visibleRegionScreen.rects = &target->displayFrame;
+
+    // GL content has to be blended onto whatever is below it
+    if (haveOverlaysBelow) {
+        content->blending = HWC_BLENDING_PREMULT;
+        target->blending = HWC_BLENDING_PREMULT;
+    }
+
+    if (list->numHwLayers != count || overlayFrames != m_lastOverlayFrames)
+        list->flags |= HWC_GEOMETRY_CHANGED;
+    list->numHwLayers = count;
+    m_lastOverlayFrames = overlayFrames;
+
+    *contentlayer = content;
+    *fblayer = target;
+}
+
+void HWComposer::presentBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame)
+{
+    int releaseFenceFd = presentTarget(buffer->handle, getFenceBufferFd(buffer), frame);
+    setFenceBufferFd(buffer, releaseFenceFd);
+}
+
+bool HWComposer::presentClientBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                                     HwComposerFenceMonitor::Listener *releaseListener, int releaseId)
+{
+    // Only buffers covering the whole display can replace the GL content
+    if (buffer->width != (int)width() || buffer->height != (int)height())
+        return false;
+
+    // GL frames queued before this buffer have to reach the display first
+    waitForPresent();
+
+    // The release fence of the target layer signals once the display has
+    // moved on to a later frame
+    int releaseFenceFd = presentTarget(buffer->handle, acquireFenceFd, HwComposerFrame());
+    HwComposerFenceMonitor::instance()->watchOrPoll(releaseFenceFd, releaseListener, releaseId);
+    return true;
+}
+
+int HWComposer::presentTarget(buffer_handle_t handle, int acquireFenceFd, const HwComposerFrame &frame)
 {
     QSystraceEvent trace("graphics", "QPA::present");
+    QMutexLocker lock(&m_presentMutex);
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::FirstPresent);
 
     QPA_HWC_TIMING_SAMPLE(presentTime);
 
-    fblayer->handle = buffer->handle;
-    fblayer->releaseFenceFd = -1;
+    QVector<HwcOverlayLayer> overlays = frame.overlays;
+    QVector<hwc_layer_1_t *> overlayLayers;
+    hwc_layer_1_t *contentlayer;
+    hwc_layer_1_t *fblayer;
 
-    int retireFenceFd = -1;
-
-    if (m_waitOnRetireFence) {
-        retireFenceFd = mlist[0]->retireFenceFd;
-        mlist[0]->retireFenceFd = -1;
+#ifdef HWC_DEVICE_API_VERSION_1_5
+    // An empty list of rects tells the hwc that the whole buffer changed
+    QRect bufferRect(0, 0, width(), height());
+    QRegion clippedDamage = frame.damage & bufferRect;
+    m_damageRects.clear();
+    if (!clippedDamage.isEmpty() && clippedDamage != QRegion(bufferRect)) {
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 8, 0))
+        for (const QRect &rect : clippedDamage) {
+#else
+        for (const QRect &rect : clippedDamage.rects()) {
+#endif
+            hwc_rect_t r = { rect.left(), rect.top(), rect.right() + 1, rect.bottom() + 1 };
+            m_damageRects.append(r);
+        }
     }
+#endif
 
     if (m_syncBeforeSet) {
-        int acqFd = getFenceBufferFd(buffer);
-        if (acqFd >= 0) {
-            sync_wait(acqFd, -1);
-            close(acqFd);
-            fblayer->acquireFenceFd = -1;
+        if (acquireFenceFd >= 0) {
+            sync_wait(acquireFenceFd, -1);
+            close(acquireFenceFd);
         }
-    } else {
-        fblayer->acquireFenceFd = getFenceBufferFd(buffer);
+        acquireFenceFd = -1;
     }
 
     QPA_HWC_TIMING_SAMPLE(syncTime);
 
-    int err = hwcdevice->prepare(hwcdevice, num_displays, mlist);
-    HWC_PLUGIN_EXPECT_ZERO(err);
+    // Overlays left to GLES composition would be missing from the frame,
+    // the GL content doesn't have them. They are reported as turned down
+    // and taken out of the list, which is prepared again without them, so
+    // the frame the compositor swapped is still shown. The compositor gets
+    // an update to draw them with GL.
+    bool declined = false;
+    for (;;) {
+        overlayLayers.clear();
+        buildLayerList(overlays, overlayLayers, &contentlayer, &fblayer);
+
+        fblayer->handle = handle;
+        fblayer->releaseFenceFd = -1;
+        fblayer->acquireFenceFd = acquireFenceFd;
+#ifdef HWC_DEVICE_API_VERSION_1_5
+        fblayer->surfaceDamage.numRects = m_damageRects.size();
+        fblayer->surfaceDamage.rects = m_damageRects.constData();
+        contentlayer->surfaceDamage = fblayer->surfaceDamage;
+#else
+        Q_UNUSED(contentlayer);
+#endif
+
+        int err = hwcdevice->prepare(hwcdevice, num_displays, mlist);
+        HWC_PLUGIN_EXPECT_ZERO(err);
+
+        QVector<HwcOverlayLayer> accepted;
+        for (int i = 0; i < overlays.size(); i++) {
+            if (overlayLayers.at(i)->compositionType == HWC_FRAMEBUFFER)
+                HwComposerBackend::rejectOverlayLayer(overlays.at(i));
+            else
+                accepted.append(overlays.at(i));
+        }
+        if (accepted.size() == overlays.size())
+            break;
+
+        overlays = accepted;
+        mlist[0]->flags |= HWC_GEOMETRY_CHANGED;
+        declined = true;
+    }
+
+    if (declined)
+        m_backend->overlaysDeclined();
 
     QPA_HWC_TIMING_SAMPLE(prepareTime);
 
     QSystrace::begin("graphics", "QPA::set", "");
-    err = hwcdevice->set(hwcdevice, num_displays, mlist);
+    int err = hwcdevice->set(hwcdevice, num_displays, mlist);
     HWC_PLUGIN_EXPECT_ZERO(err);
     QSystrace::end("graphics", "QPA::set", "");
 
     QPA_HWC_TIMING_SAMPLE(setTime);
 
-    setFenceBufferFd(buffer, fblayer->releaseFenceFd);
+    int releaseFenceFd = fblayer->releaseFenceFd;
 
-    if (m_waitOnRetireFence && retireFenceFd != -1) {
-        sync_wait(retireFenceFd, -1);
+    for (int i = 0; i < overlays.size(); i++) {
+        const HwcOverlayLayer &overlay = overlays.at(i);
+        int overlayReleaseFd = overlayLayers.at(i)->releaseFenceFd;
+        if (overlay.presented)
+            overlay.presented(overlay.userData, true, overlayReleaseFd);
+        else if (overlayReleaseFd != -1)
+            close(overlayReleaseFd);
+    }
+
+    // The backend throttles update delivery against the retire fence
+    int retireFenceFd = mlist[0]->retireFenceFd;
+    mlist[0]->retireFenceFd = -1;
+    if (retireFenceFd != -1 &&
+        !HwComposerFenceMonitor::instance()->watch(retireFenceFd, m_backend)) {
+        // Without the monitor there is nothing to throttle on, so block
+        // only if asked to wait on the retire fence
+        if (m_waitOnRetireFence)
+            sync_wait(retireFenceFd, -1);
         close(retireFenceFd);
-    } else if (!m_waitOnRetireFence && mlist[0]->retireFenceFd != -1) {
-        close(mlist[0]->retireFenceFd);
-        mlist[0]->retireFenceFd = -1;
     }
+
+    qint64 target;
+    qint64 now = HwComposerFenceMonitor::now();
+    if (m_frameScheduler && m_frameScheduler->framePresented(now, &target) && m_bufferPolicy)
+        m_bufferPolicy->framePresented(target, now);
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::FirstPresent);
+
+    return releaseFenceFd;
 }
 
 HwComposerBackend_v11::HwComposerBackend_v11(hw_module_t *hwc_module, hw_device_t *hw_device, void *libminisf, int num_displays)
@@ -185,7 +493,20 @@ HwComposerBackend_v11::HwComposerBackend_v11(hw_module_t *hwc_module, hw_device_
     , hwc_mList(NULL)
     , num_displays(num_displays)
     , m_displayOff(true)
+    , m_window(NULL)
+    , m_waitOnRetireFence(qEnvironmentVariableIsSet("QPA_HWC_WAIT_ON_RETIRE_FENCE"))
+    , m_vsyncNotifier(new HwComposerVsyncNotifier(this, this))
+    , m_configsLoaded(false)
+    , m_activeConfig(0)
+    , m_idleRefreshTime(-1)
+    , m_normalMode(-1)
+    , m_idleMode(-1)
+    , m_idleRefreshActive(0)
+    , m_lastActivity(0)
 {
+    if (HwComposerSoftwareVsync::isEnabled())
+        m_softwareVsync = new HwComposerSoftwareVsync(&m_vsyncTimeline, this, this);
+
     procs = new HwcProcs_v11();
     procs->invalidate = hwc11_callback_invalidate;
     procs->hotplug = hwc11_callback_hotplug;
@@ -195,11 +516,25 @@ HwComposerBackend_v11::HwComposerBackend_v11(hw_module_t *hwc_module, hw_device_
     hwc_device->registerProcs(hwc_device, procs);
 
     hwc_version = interpreted_version(hw_device);
+    m_vsyncTimeline.setNominalPeriod(1000000000.0 / refreshRate());
     sleepDisplay(false);
+
+    // Before the screen and the probe cache read the active mode
+    m_normalMode = normalDisplayMode();
+    if (m_normalMode != activeDisplayMode() && switchDisplayConfig(m_normalMode))
+        qDebug("Restored the refresh rate to %.2f Hz", refreshRate());
 }
 
 HwComposerBackend_v11::~HwComposerBackend_v11()
 {
+    HwComposerFenceMonitor::instance()->removeListener(this);
+
+    // The next start takes whatever mode is active. The window went away
+    // with its EGL surface.
+    m_window = NULL;
+    m_idleRefreshTimeout.stop();
+    leaveIdleRefresh();
+
     hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 0);
 
     // Close the hwcomposer handle
@@ -231,7 +566,7 @@ HwComposerBackend_v11::createWindow(int width, int height)
     HWC_PLUGIN_EXPECT_NULL(hwc_list);
     HWC_PLUGIN_EXPECT_NULL(hwc_mList);
 
-    size_t neededsize = sizeof(hwc_display_contents_1_t) + 2 * sizeof(hwc_layer_1_t);
+    size_t neededsize = sizeof(hwc_display_contents_1_t) + (2 + HWC_PLUGIN_MAX_OVERLAYS) * sizeof(hwc_layer_1_t);
     hwc_list = (hwc_display_contents_1_t *) malloc(neededsize);
     hwc_mList = (hwc_display_contents_1_t **) malloc(num_displays * sizeof(hwc_display_contents_1_t *));
     const hwc_rect_t r = { 0, 0, width, height };
@@ -317,7 +652,10 @@ HwComposerBackend_v11::createWindow(int width, int height)
 
 
     HWComposer *hwc_win = new HWComposer(width, height, HAL_PIXEL_FORMAT_RGBA_8888,
-                                         hwc_device, hwc_mList, &hwc_list->hwLayers[1], num_displays);
+                                         hwc_device, hwc_mList, num_displays, this);
+    hwc_win->setVsyncPeriod(displayAttributes(-1).vsyncPeriod);
+    hwc_win->setFrameScheduler(&m_frameScheduler);
+    m_window = hwc_win;
     return (EGLNativeWindowType) static_cast<ANativeWindow *>(hwc_win);
 }
 
@@ -327,6 +665,46 @@ HwComposerBackend_v11::destroyWindow(EGLNativeWindowType window)
     Q_UNUSED(window);
 }
 
+int
+HwComposerBackend_v11::bufferCount()
+{
+    return m_window ? m_window->bufferCount() : 0;
+}
+
+void
+HwComposerBackend_v11::setSwapVsyncDivisor(int divisor)
+{
+    if (m_window)
+        m_window->setVsyncDivisor(divisor);
+}
+
+void
+HwComposerBackend_v11::setSwapDamage(const QRegion &damage)
+{
+    if (m_window)
+        m_window->setDamage(damage);
+}
+
+void
+HwComposerBackend_v11::setOverlayLayers(const QVector<HwcOverlayLayer> &layers)
+{
+    if (m_window)
+        m_window->setOverlayLayers(layers);
+    else
+        HwComposerBackend::setOverlayLayers(layers);
+}
+
+bool
+HwComposerBackend_v11::displayBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                                     HwComposerFenceMonitor::Listener *releaseListener, int releaseId)
+{
+    if (!m_window || m_displayOff)
+        return false;
+
+    recordFrameActivity();
+    return m_window->presentClientBuffer(buffer, acquireFenceFd, releaseListener, releaseId);
+}
+
 void
 HwComposerBackend_v11::swap(EGLNativeDisplayType display, EGLSurface surface)
 {
@@ -334,6 +712,8 @@ HwComposerBackend_v11::swap(EGLNativeDisplayType display, EGLSurface surface)
     timer.start();
 #endif
 
+    // Windows may render without asking for updates
+    recordFrameActivity();
     eglSwapBuffers(display, surface);
 
 #ifdef QPA_HWC_TIMING
@@ -351,11 +731,16 @@ HwComposerBackend_v11::sleepDisplay(bool sleep)
 {
     m_displayOff = sleep;
     if (sleep) {
-        // Stop the timer so we don't end up calling into eventControl after the
-        // screen has been turned off. Doing so leads to logcat errors being
-        // logged.
-        m_vsyncTimeout.stop();
-        hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 0);
+        // Let the present thread finish queued frames before blanking
+        if (m_window)
+            m_window->waitForPresent();
+
+        // Retire fences of a blanked display are no use for throttling
+        HwComposerFenceMonitor::instance()->removeListener(this);
+
+        m_idleRefreshTimeout.stop();
+        leaveIdleRefresh();
+        suspendVsync();
 
 #ifdef HWC_DEVICE_API_VERSION_1_4
         if (hwc_version == HWC_DEVICE_API_VERSION_1_4) {
@@ -385,63 +770,249 @@ HwComposerBackend_v11::sleepDisplay(bool sleep)
             hwc_list->flags |= HWC_GEOMETRY_CHANGED;
         }
 
-        // If we have pending updates, make sure those start happening now..
-        if (m_pendingUpdate.size()) {
-            hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 1);
-            m_vsyncTimeout.start(50, this);
-        }
+        resumeVsync();
     }
 }
 
-int HwComposerBackend_v11::getSingleAttribute(uint32_t attribute)
+bool HwComposerBackend_v11::canSwitchConfigs() const
 {
-    uint32_t config;
-
-    if (hwc_version == HWC_DEVICE_API_VERSION_1_1
-#ifdef HWC_DEVICE_API_VERSION_1_2
-        || hwc_version == HWC_DEVICE_API_VERSION_1_2
+#ifdef HWC_DEVICE_API_VERSION_1_4
+    // Before 1.4 the active config is always the first one
+    return hwc_version >= HWC_DEVICE_API_VERSION_1_4;
+#else
+    return false;
 #endif
-#ifdef HWC_DEVICE_API_VERSION_1_3
-        || hwc_version == HWC_DEVICE_API_VERSION_1_3
+}
+
+void HwComposerBackend_v11::loadDisplayConfigsLocked()
+{
+    if (m_configsLoaded)
+        return;
+
+    uint32_t configs[HWC_PLUGIN_MAX_CONFIGS];
+    size_t numConfigs = canSwitchConfigs() ? HWC_PLUGIN_MAX_CONFIGS : 1;
+    m_configs.clear();
+    if (hwc_device->getDisplayConfigs(hwc_device, 0, configs, &numConfigs) == 0) {
+        for (size_t i = 0; i < numConfigs && i < HWC_PLUGIN_MAX_CONFIGS; i++)
+            m_configs.append(configs[i]);
+    }
+    m_attributes.fill(DisplayAttributes(), m_configs.size());
+
+    // getActiveConfig() gives an index into the config list, not a config
+    m_activeConfig = 0;
+#ifdef HWC_DEVICE_API_VERSION_1_4
+    if (canSwitchConfigs())
+        m_activeConfig = hwc_device->getActiveConfig(hwc_device, 0);
 #endif
-)
-    {
-        /* 1.3 or lower, currently active config is the first config */
-        size_t numConfigs = 1;
-        hwc_device->getDisplayConfigs(hwc_device, 0, &config, &numConfigs);
+    if (m_activeConfig < 0 || m_activeConfig >= m_configs.size())
+        m_activeConfig = 0;
+
+    m_configsLoaded = true;
+}
+
+HwComposerBackend_v11::DisplayAttributes HwComposerBackend_v11::displayAttributes(int index)
+{
+    QMutexLocker locker(&m_attributesMutex);
+    loadDisplayConfigsLocked();
+
+    if (index < 0)
+        index = m_activeConfig;
+    if (index >= m_configs.size())
+        return DisplayAttributes();
+
+    DisplayAttributes &cached = m_attributes[index];
+    if (!cached.valid) {
+        // All we need in one go, each call is a round trip on some devices
+        const uint32_t attributes[] = {
+            HWC_DISPLAY_WIDTH,
+            HWC_DISPLAY_HEIGHT,
+            HWC_DISPLAY_VSYNC_PERIOD,
+            HWC_DISPLAY_DPI_X,
+            HWC_DISPLAY_DPI_Y,
+            HWC_DISPLAY_NO_ATTRIBUTE,
+        };
+        int32_t values[] = { 0, 0, 0, 0, 0, 0 };
+        int res = hwc_device->getDisplayAttributes(hwc_device, 0, m_configs.at(index), attributes, values);
+
+        cached.width = values[0];
+        cached.height = values[1];
+        cached.vsyncPeriod = values[2];
+        cached.dpiX = values[3];
+        cached.dpiY = values[4];
+        // Ask again next time rather than keep zeros until a hotplug
+        cached.valid = res == 0;
+        if (res != 0)
+            qWarning("QPA-HWC: getDisplayAttributes(%d) failed: %d", index, res);
     }
+    return cached;
+}
+
+void HwComposerBackend_v11::invalidateDisplayAttributes()
+{
+    QMutexLocker locker(&m_attributesMutex);
+    m_configsLoaded = false;
+}
+
+int HwComposerBackend_v11::activeDisplayMode()
+{
+    QMutexLocker locker(&m_attributesMutex);
+    loadDisplayConfigsLocked();
+    return m_configs.isEmpty() ? -1 : m_activeConfig;
+}
+
+QVector<HwComposerDisplayMode> HwComposerBackend_v11::displayModes()
+{
+    m_attributesMutex.lock();
+    loadDisplayConfigsLocked();
+    int count = m_configs.size();
+    m_attributesMutex.unlock();
+
+    QVector<HwComposerDisplayMode> modes;
+    for (int i = 0; i < count; i++) {
+        DisplayAttributes attributes = displayAttributes(i);
+
+        HwComposerDisplayMode mode;
+        mode.width = attributes.width;
+        mode.height = attributes.height;
+        mode.refreshRate = attributes.vsyncPeriod > 0 ? 1000000000.0 / attributes.vsyncPeriod : 60.0;
+        modes.append(mode);
+    }
+    return modes;
+}
+
+bool HwComposerBackend_v11::setActiveDisplayMode(int index)
+{
+    leaveIdleRefresh();
+    if (!switchDisplayConfig(index))
+        return false;
+
+    m_normalMode = index;
+    setupIdleRefresh();
+    return true;
+}
+
+bool HwComposerBackend_v11::switchDisplayConfig(int index)
+{
 #ifdef HWC_DEVICE_API_VERSION_1_4
-    else {
-        /* 1.4 or higher */
-        config = hwc_device->getActiveConfig(hwc_device, 0);
+    if (!canSwitchConfigs() || index < 0 || index >= displayModes().size())
+        return false;
+    if (index == activeDisplayMode())
+        return true;
+
+    // Frames queued for the old timing go out first
+    if (m_window)
+        m_window->waitForPresent();
+
+    int res = hwc_device->setActiveConfig(hwc_device, 0, index);
+    if (res != 0) {
+        qWarning("QPA-HWC: setActiveConfig(%d) failed: %d", index, res);
+        return false;
     }
-#endif
 
-    const uint32_t attributes[] = {
-        attribute,
-        HWC_DISPLAY_NO_ATTRIBUTE,
-    };
+    m_attributesMutex.lock();
+    m_activeConfig = index;
+    m_attributesMutex.unlock();
 
-    int32_t values[] = {
-        0,
-        0,
-    };
+    qint64 period = displayAttributes(index).vsyncPeriod;
+    if (period > 0) {
+        m_vsyncTimeline.setNominalPeriod(period);
+        if (m_window)
+            m_window->setVsyncPeriod(period);
+    }
+    return true;
+#else
+    Q_UNUSED(index);
+    return false;
+#endif
+}
 
-    hwc_device->getDisplayAttributes(hwc_device, 0, config, attributes, values);
+int HwComposerBackend_v11::normalDisplayMode()
+{
+    // A previous run may have exited at the idle rate, so the active mode
+    // can't tell. The rate the probe cache kept for this display wins.
+    int active = activeDisplayMode();
+    HwComposerProbeCache::Entry cached;
+    if (active < 0 || !canSwitchConfigs() ||
+        !HwComposerProbeCache::instance()->lookup(&cached) || cached.refreshRate <= 0)
+        return active;
+
+    QVector<HwComposerDisplayMode> modes = displayModes();
+    const HwComposerDisplayMode &current = modes.at(active);
+    for (int i = 0; i < modes.size(); i++) {
+        const HwComposerDisplayMode &mode = modes.at(i);
+        if (mode.width == current.width && mode.height == current.height &&
+            qAbs(mode.refreshRate - cached.refreshRate) < 0.5f)
+            return i;
+    }
+    return active;
+}
 
-    for (unsigned int i = 0; i < sizeof(attributes) / sizeof(uint32_t); i++) {
-        if (attributes[i] == attribute) {
-            return values[i];
+void HwComposerBackend_v11::setupIdleRefresh()
+{
+    m_idleRefreshTimeout.stop();
+    m_idleMode = -1;
+
+    QByteArray env = qgetenv("QPA_HWC_IDLE_REFRESH_TIME");
+    m_idleRefreshTime = env.isEmpty() ? 1000 : env.toInt();
+    if (m_idleRefreshTime <= 0 || !canSwitchConfigs())
+        return;
+
+    // The slowest mode at the resolution we run at
+    QVector<HwComposerDisplayMode> modes = displayModes();
+    if (m_normalMode < 0 || m_normalMode >= modes.size())
+        return;
+    const HwComposerDisplayMode &normal = modes.at(m_normalMode);
+    float slowest = normal.refreshRate - 1;
+    for (int i = 0; i < modes.size(); i++) {
+        const HwComposerDisplayMode &mode = modes.at(i);
+        if (mode.width == normal.width && mode.height == normal.height && mode.refreshRate < slowest) {
+            slowest = mode.refreshRate;
+            m_idleMode = i;
         }
     }
 
-    return 0;
+    if (m_idleMode != -1)
+        qDebug("Idle refresh rate %.2f Hz after %d ms", modes.at(m_idleMode).refreshRate, m_idleRefreshTime);
+}
+
+void HwComposerBackend_v11::leaveIdleRefresh()
+{
+    if (!m_idleRefreshActive.loadAcquire())
+        return;
+
+    m_idleRefreshActive.storeRelease(0);
+    if (QCoreApplication::instance())
+        QCoreApplication::instance()->removeEventFilter(this);
+    switchDisplayConfig(m_normalMode);
+}
+
+void HwComposerBackend_v11::overlaysDeclined()
+{
+    QCoreApplication::postEvent(this, new QEvent(OverlaysDeclinedEvent));
+}
+
+void HwComposerBackend_v11::recordFrameActivity()
+{
+    // Any thread. The idle timer only looks at the time once it fires,
+    // leaving the idle rate is up to the GUI thread.
+    m_lastActivity.storeRelease(HwComposerFenceMonitor::now());
+    if (m_idleRefreshActive.loadAcquire())
+        QCoreApplication::postEvent(this, new QEvent(FrameActivityEvent));
+}
+
+bool HwComposerBackend_v11::eventFilter(QObject *object, QEvent *e)
+{
+    // A touch is about to cause updates, get the rate back up front
+    if (e->type() == QEvent::TouchBegin)
+        leaveIdleRefresh();
+    return QObject::eventFilter(object, e);
 }
 
 float
 HwComposerBackend_v11::refreshRate()
 {
-    float value = (float)getSingleAttribute(HWC_DISPLAY_VSYNC_PERIOD);
+    // The rate the display runs at while in use, not the idle one
+    float value = (float)displayAttributes(m_normalMode).vsyncPeriod;
 
     value = (1000000000.0 / value);
 
@@ -452,11 +1023,12 @@ HwComposerBackend_v11::refreshRate()
 bool
 HwComposerBackend_v11::getScreenSizes(int *width, int *height, float *physical_width, float *physical_height)
 {
-    int dpi_x = getSingleAttribute(HWC_DISPLAY_DPI_X) / 1000;
-    int dpi_y = getSingleAttribute(HWC_DISPLAY_DPI_Y) / 1000;
+    DisplayAttributes attributes = displayAttributes(-1);
+    int dpi_x = attributes.dpiX / 1000;
+    int dpi_y = attributes.dpiY / 1000;
 
-    *width = getSingleAttribute(HWC_DISPLAY_WIDTH);
-    *height = getSingleAttribute(HWC_DISPLAY_HEIGHT);
+    *width = attributes.width;
+    *height = attributes.height;
 
     if (dpi_x == 0 || dpi_y == 0 || *width == 0 || *height == 0) {
         qWarning() << "failed to read screen size from hwc1.x backend";
@@ -471,48 +1043,75 @@ HwComposerBackend_v11::getScreenSizes(int *width, int *height, float *physical_w
 
 void HwComposerBackend_v11::timerEvent(QTimerEvent *e)
 {
-    if (e->timerId() == m_vsyncTimeout.timerId()) {
-        hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 0);
-        m_vsyncTimeout.stop();
-        // When waking up, we might get here as a result of requesting vsync events
-        // before the hwc is up and running. If we're timing out while still waiting
-        // for vsync to occur, trigger the update so we don't block the UI.
-        if (!m_pendingUpdate.isEmpty())
-            handleVSyncEvent();
-    } else if (e->timerId() == m_deliverUpdateTimeout.timerId()) {
-        m_deliverUpdateTimeout.stop();
-        handleVSyncEvent();
+    if (e->timerId() == m_idleRefreshTimeout.timerId()) {
+        m_idleRefreshTimeout.stop();
+        qint64 idle = (HwComposerFenceMonitor::now() - m_lastActivity.loadAcquire()) / 1000000;
+        if (idle < m_idleRefreshTime) {
+            m_idleRefreshTimeout.start(m_idleRefreshTime - idle, this);
+        } else if (!m_displayOff && !hasPendingUpdates() && switchDisplayConfig(m_idleMode)) {
+            m_idleRefreshActive.storeRelease(1);
+            QCoreApplication::instance()->installEventFilter(this);
+        }
     }
 }
 
 bool HwComposerBackend_v11::event(QEvent *e)
 {
-    if (e->type() == QEvent::User) {
-        static int idleTime = qBound(5, qgetenv("QPA_HWC_IDLE_TIME").toInt(), 100);
-        if (!m_deliverUpdateTimeout.isActive())
-            m_deliverUpdateTimeout.start(idleTime, this);
+    if (e->type() == FenceSignaledEvent) {
+        if (hasPendingUpdates())
+            deliverPendingUpdates();
+        return true;
+    } else if (e->type() == OverlaysDeclinedEvent) {
+        // The compositor draws the turned down overlays with GL from now on
+        if (!m_displayOff) {
+            foreach (QWindow *window, QGuiApplication::topLevelWindows()) {
+                if (window->handle())
+                    scheduleUpdate(window);
+            }
+        }
+        return true;
+    } else if (e->type() == FrameActivityEvent) {
+        leaveIdleRefresh();
+        if (m_idleMode != -1 && !m_idleRefreshTimeout.isActive())
+            m_idleRefreshTimeout.start(m_idleRefreshTime, this);
         return true;
     }
     return QObject::event(e);
 }
 
-void HwComposerBackend_v11::handleVSyncEvent()
+void HwComposerBackend_v11::fenceSignaled(int, qint64 timestamp)
 {
-    QSystraceEvent trace("graphics", "QPA::handleVsync");
-    QSet<QWindow *> pendingWindows = m_pendingUpdate;
-    m_pendingUpdate.clear();
-    foreach (QWindow *w, pendingWindows) {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 12, 0))
-        QPlatformWindow *platformWindow = w->handle();
-        if (!platformWindow)
-            continue;
+    HwComposerStartupTimeline::mark(HwComposerStartupTimeline::FirstPresentFence, timestamp);
 
-        platformWindow->deliverUpdateRequest();
-#else
-        QWindowPrivate *wp = (QWindowPrivate *) QWindowPrivate::get(w);
-        wp->deliverUpdateRequest();
-#endif
-    }
+    // The fences signal on vsync, so they show whether the model drifted
+    if (m_softwareVsync)
+        m_softwareVsync->presentFenceSignaled(timestamp);
+
+    // Only wake up the GUI thread if an update is held back by this fence
+    if (m_waitingForFence.testAndSetOrdered(1, 0))
+        QCoreApplication::postEvent(this, new QEvent(FenceSignaledEvent));
+}
+
+bool HwComposerBackend_v11::throttleUpdates()
+{
+    if (!m_waitOnRetireFence)
+        return false;
+
+    // Allow one frame in flight, like waiting on the previous retire fence
+    // after set did. Held back updates are delivered from event() once the
+    // retire fence signals.
+    HwComposerFenceMonitor *monitor = HwComposerFenceMonitor::instance();
+    if (monitor->pendingCount(this) <= 1)
+        return false;
+
+    m_waitingForFence.storeRelease(1);
+
+    // The fence may have signaled before we raised the flag
+    if (monitor->pendingCount(this) > 1)
+        return true;
+
+    m_waitingForFence.storeRelease(0);
+    return false;
 }
 
 bool HwComposerBackend_v11::requestUpdate(QEglFSWindow *window)
@@ -521,14 +1120,26 @@ bool HwComposerBackend_v11::requestUpdate(QEglFSWindow *window)
     if (m_displayOff)
         return false;
 
-    if (m_vsyncTimeout.isActive()) {
-        m_vsyncTimeout.stop();
-    } else {
-        hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, 1);
+    // Looking at all display configs can wait for the first frame
+    if (m_idleRefreshTime < 0)
+        setupIdleRefresh();
+
+    // Restarting the timer on every frame would cost more than checking
+    // the time of the last request once it fires
+    if (m_idleMode != -1) {
+        m_lastActivity.storeRelease(HwComposerFenceMonitor::now());
+        leaveIdleRefresh();
+        if (!m_idleRefreshTimeout.isActive())
+            m_idleRefreshTimeout.start(m_idleRefreshTime, this);
     }
-    m_vsyncTimeout.start(50, this);
-    m_pendingUpdate.insert(window->window());
+
+    scheduleUpdate(window->window());
     return true;
 }
 
+void HwComposerBackend_v11::setHardwareVsyncEnabled(bool enabled)
+{
+    hwc_device->eventControl(hwc_device, 0, HWC_EVENT_VSYNC, enabled ? 1 : 0);
+}
+
 #endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
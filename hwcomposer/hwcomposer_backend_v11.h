@@ -45,17 +45,24 @@
 #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
 
 #include "hwcomposer_backend.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_vsyncnotifier.h"
+#include "hwcomposer_softwarevsync.h"
 
 // libhybris access to the native hwcomposer window
 #include <hwcomposer_window.h>
 
 #include <QObject>
 #include <QBasicTimer>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QVector>
 
 class HwcProcs_v11;
-class QWindow;
+class HWComposer;
 
-class HwComposerBackend_v11 : public QObject, public HwComposerBackend {
+class HwComposerBackend_v11 : public QObject, public HwComposerBackend, public HwComposerFenceMonitor::Listener {
 public:
     HwComposerBackend_v11(hw_module_t *hwc_module, hw_device_t *hw_device, void *libminisf, int num_displays);
     virtual ~HwComposerBackend_v11();
@@ -64,18 +71,65 @@ public:
     virtual EGLNativeWindowType createWindow(int width, int height);
     virtual void destroyWindow(EGLNativeWindowType window);
     virtual void swap(EGLNativeDisplayType display, EGLSurface surface);
+    virtual void setSwapDamage(const QRegion &damage) Q_DECL_OVERRIDE;
+    virtual void setOverlayLayers(const QVector<HwcOverlayLayer> &layers) Q_DECL_OVERRIDE;
+    virtual bool displayBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                               HwComposerFenceMonitor::Listener *releaseListener, int releaseId) Q_DECL_OVERRIDE;
+    virtual int bufferCount() Q_DECL_OVERRIDE;
+    virtual void setSwapVsyncDivisor(int divisor) Q_DECL_OVERRIDE;
+    virtual QVector<HwComposerDisplayMode> displayModes() Q_DECL_OVERRIDE;
+    virtual int activeDisplayMode() Q_DECL_OVERRIDE;
+    virtual bool setActiveDisplayMode(int index) Q_DECL_OVERRIDE;
     virtual void sleepDisplay(bool sleep);
     virtual float refreshRate();
     virtual bool getScreenSizes(int *width, int *height, float *physical_width, float *physical_height);
 
     virtual bool requestUpdate(QEglFSWindow *window) Q_DECL_OVERRIDE;
+    virtual QObject *object() Q_DECL_OVERRIDE { return this; }
 
     void timerEvent(QTimerEvent *) Q_DECL_OVERRIDE;
-    void handleVSyncEvent();
     bool event(QEvent *e) Q_DECL_OVERRIDE;
+    bool eventFilter(QObject *object, QEvent *e) Q_DECL_OVERRIDE;
+
+    void fenceSignaled(int id, qint64 timestamp) Q_DECL_OVERRIDE;
+
+    // Display configs changed, from the hotplug callback
+    void invalidateDisplayAttributes();
+    // Present thread: the hwc turned down overlays of a frame, the
+    // compositor needs an update to draw them with GL
+    void overlaysDeclined();
+
+    HwComposerVsyncNotifier *vsyncNotifier() const { return m_vsyncNotifier; }
+
+protected:
+    void setHardwareVsyncEnabled(bool enabled) Q_DECL_OVERRIDE;
+    bool throttleUpdates() Q_DECL_OVERRIDE;
 
 private:
-    int getSingleAttribute(uint32_t attribute);
+    static const QEvent::Type FenceSignaledEvent = QEvent::Type(QEvent::User + 1);
+    static const QEvent::Type FrameActivityEvent = QEvent::Type(QEvent::User + 2);
+    static const QEvent::Type OverlaysDeclinedEvent = QEvent::Type(QEvent::User + 3);
+
+    struct DisplayAttributes {
+        DisplayAttributes() : valid(false), width(0), height(0), vsyncPeriod(0), dpiX(0), dpiY(0) {}
+        bool valid;
+        int32_t width;
+        int32_t height;
+        int32_t vsyncPeriod;
+        int32_t dpiX;
+        int32_t dpiY;
+    };
+
+    // Attributes of a config of the primary display, -1 for the active
+    // one. Read with one getDisplayAttributes call the first time needed.
+    DisplayAttributes displayAttributes(int index);
+    void loadDisplayConfigsLocked();
+    bool canSwitchConfigs() const;
+    bool switchDisplayConfig(int index);
+    int normalDisplayMode();
+    void setupIdleRefresh();
+    void leaveIdleRefresh();
+    void recordFrameActivity();
     hwc_composer_device_1_t *hwc_device;
     hwc_display_contents_1_t *hwc_list;
     hwc_display_contents_1_t **hwc_mList;
@@ -83,10 +137,27 @@ private:
     int num_displays;
 
     bool m_displayOff;
-    QBasicTimer m_deliverUpdateTimeout;
-    QBasicTimer m_vsyncTimeout;
-    QSet<QWindow *> m_pendingUpdate;
     HwcProcs_v11 *procs;
+    HWComposer *m_window;
+
+    bool m_waitOnRetireFence;
+    QAtomicInt m_waitingForFence;
+    HwComposerVsyncNotifier *m_vsyncNotifier;
+
+    QMutex m_attributesMutex;
+    bool m_configsLoaded;
+    QVector<uint32_t> m_configs;
+    QVector<DisplayAttributes> m_attributes;
+    int m_activeConfig;
+
+    // Drop to the slowest refresh rate after idle time without updates
+    int m_idleRefreshTime;
+    int m_normalMode;
+    int m_idleMode;
+    // Frames are presented from the render and screen threads too
+    QAtomicInt m_idleRefreshActive;
+    QAtomicInteger<qint64> m_lastActivity;
+    QBasicTimer m_idleRefreshTimeout;
 };
 
 #endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
@@ -41,13 +41,16 @@
 
 #include <android-version.h>
 #include "hwcomposer_backend_v20.h"
+#include "hwcomposer_window_v20.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_startuptimeline.h"
 #include "qeglfswindow.h"
 
 #include <string>
 #include <QtCore/QElapsedTimer>
-#include <QtCore/QTimerEvent>
 #include <QtCore/QCoreApplication>
-#include <private/qwindow_p.h>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
 
 #include "qsystrace_selector.h"
 
@@ -55,27 +58,19 @@
 
 // #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
 
-// #define QPA_HWC_TIMING
-
-#ifdef QPA_HWC_TIMING
-#define QPA_HWC_TIMING_SAMPLE(variable) variable = timer.nsecsElapsed()
-static QElapsedTimer timer;
-static qint64 presentTime;
-static qint64 syncTime;
-static qint64 prepareTime;
-static qint64 setTime;
-#else
-#define QPA_HWC_TIMING_SAMPLE(variable)
-#endif
 
 struct HwcProcs_v20 : public HWC2EventListener
 {
     HwComposerBackend_v20 *backend;
     hwc2_display_t primaryDisplayId;
+
+    // Start-up waits on this for the display to be hotplugged
+    QMutex hotplugMutex;
+    QWaitCondition hotplugCondition;
 };
 
 void hwc2_callback_vsync(HWC2EventListener* listener, int32_t /*sequenceId*/,
-                         hwc2_display_t /*display*/, int64_t /*timestamp*/)
+                         hwc2_display_t /*display*/, int64_t timestamp)
 {
     static int counter = 0;
     ++counter;
@@ -84,8 +79,9 @@ void hwc2_callback_vsync(HWC2EventListener* listener, int32_t /*sequenceId*/,
     else
         QSystrace::end("graphics", "QPA::vsync", "");
 
-    QCoreApplication::postEvent(static_cast<const HwcProcs_v20 *>(listener)->backend,
-                                new QEvent(QEvent::User));
+    HwComposerBackend_v20 *backend = static_cast<const HwcProcs_v20 *>(listener)->backend;
+    backend->vsyncTimeline()->addVsync(timestamp);
+    backend->vsyncNotifier()->notify(timestamp);
 }
 
 void hwc2_callback_hotplug(HWC2EventListener* listener, int32_t sequenceId,
@@ -101,8 +97,12 @@ void hwc2_callback_hotplug(HWC2EventListener* listener, int32_t sequenceId,
         static_cast<HwcProcs_v20 *>(listener)->primaryDisplayId = display;
     }
 
-    static_cast<const HwcProcs_v20 *>(listener)->backend->onHotplugReceived(
-        sequenceId, display, connected, primaryDisplay);
+    HwcProcs_v20 *procs = static_cast<HwcProcs_v20 *>(listener);
+    procs->backend->onHotplugReceived(sequenceId, display, connected, primaryDisplay);
+
+    procs->hotplugMutex.lock();
+    procs->hotplugCondition.wakeAll();
+    procs->hotplugMutex.unlock();
 }
 
 void hwc2_callback_refresh(HWC2EventListener* /*listener*/, int32_t /*sequenceId*/,
@@ -110,110 +110,6 @@ void hwc2_callback_refresh(HWC2EventListener* /*listener*/, int32_t /*sequenceId
 {
 }
 
-class HWC2Window : public HWComposerNativeWindow
-{
-    private:
-        hwc2_compat_layer_t *layer;
-        hwc2_compat_display_t *hwcDisplay;
-        int lastPresentFence = -1;
-        bool m_syncBeforeSet;
-    protected:
-        void present(HWComposerNativeWindowBuffer *buffer);
-
-    public:
-
-        HWC2Window(unsigned int width, unsigned int height, unsigned int format,
-                hwc2_compat_display_t *display, hwc2_compat_layer_t *layer);
-        ~HWC2Window();
-        void set();
-};
-
-HWC2Window::HWC2Window(unsigned int width, unsigned int height,
-                    unsigned int format, hwc2_compat_display_t* display,
-                    hwc2_compat_layer_t *layer) :
-                    HWComposerNativeWindow(width, height, format),
-                    layer(layer), hwcDisplay(display)
-{
-    int bufferCount = qgetenv("QPA_HWC_BUFFER_COUNT").toInt();
-    if (bufferCount)
-        bufferCount = qBound(2, bufferCount, 8);
-    else
-        // default to triple-buffering as on Android
-        bufferCount = 3;
-    setBufferCount(bufferCount);
-    m_syncBeforeSet = qEnvironmentVariableIsSet("QPA_HWC_SYNC_BEFORE_SET");
-}
-
-HWC2Window::~HWC2Window()
-{
-    if (lastPresentFence != -1) {
-        close(lastPresentFence);
-    }
-}
-
-void HWC2Window::present(HWComposerNativeWindowBuffer *buffer)
-{
-    uint32_t numTypes = 0;
-    uint32_t numRequests = 0;
-    int displayId = 0;
-    hwc2_error_t error = HWC2_ERROR_NONE;
-
-    QSystraceEvent trace("graphics", "QPA::present");
-
-    QPA_HWC_TIMING_SAMPLE(presentTime);
-
-    int acquireFenceFd = getFenceBufferFd(buffer);
-
-    if (m_syncBeforeSet && acquireFenceFd >= 0) {
-        sync_wait(acquireFenceFd, -1);
-        close(acquireFenceFd);
-        acquireFenceFd = -1;
-    }
-
-    error = hwc2_compat_display_validate(hwcDisplay, &numTypes,
-                                                    &numRequests);
-    if (error != HWC2_ERROR_NONE && error != HWC2_ERROR_HAS_CHANGES) {
-        qDebug("prepare: validate failed for display %d: %d", displayId, error);
-        return;
-    }
-
-    if (numTypes || numRequests) {
-        qDebug("prepare: validate required changes for display %d: %d",
-               displayId, error);
-        return;
-    }
-
-    error = hwc2_compat_display_accept_changes(hwcDisplay);
-    if (error != HWC2_ERROR_NONE) {
-        qDebug("prepare: acceptChanges failed: %d", error);
-        return;
-    }
-
-    QPA_HWC_TIMING_SAMPLE(prepareTime);
-
-    QSystrace::begin("graphics", "QPA::set_client_target", "");
-    hwc2_compat_display_set_client_target(hwcDisplay, /* slot */0, buffer,
-                                          acquireFenceFd,
-                                          HAL_DATASPACE_UNKNOWN);
-    QSystrace::end("graphics", "QPA::set_client_target", "");
-
-    QSystrace::begin("graphics", "QPA::present", "");
-    int presentFence = -1;
-    hwc2_compat_display_present(hwcDisplay, &presentFence);
-    QSystrace::end("graphics", "QPA::present", "");
-
-    QPA_HWC_TIMING_SAMPLE(setTime);
-
-    if (lastPresentFence != -1) {
-        sync_wait(lastPresentFence, -1);
-        close(lastPresentFence);
-    }
-
-    lastPresentFence = presentFence != -1 ? dup(presentFence) : -1;
-
-    setFenceBufferFd(buffer, presentFence);
-}
-
 int HwComposerBackend_v20::composerSequenceId = 0;
 
 HwComposerBackend_v20::HwComposerBackend_v20(hw_module_t *hwc_module, void *libminisf)
@@ -222,7 +118,13 @@ HwComposerBackend_v20::HwComposerBackend_v20(hw_module_t *hwc_module, void *libm
     , hwc2_primary_display(NULL)
     , hwc2_primary_layer(NULL)
     , m_displayOff(true)
+    , m_window(NULL)
+    , m_vsyncNotifier(new HwComposerVsyncNotifier(this, this))
+    , m_haveActiveConfig(false)
 {
+    if (HwComposerSoftwareVsync::isEnabled())
+        m_softwareVsync = new HwComposerSoftwareVsync(&m_vsyncTimeline, this, this);
+
     procs = new HwcProcs_v20();
     procs->on_vsync_received = hwc2_callback_vsync;
     procs->on_hotplug_received = hwc2_callback_hotplug;
@@ -239,21 +141,42 @@ HwComposerBackend_v20::HwComposerBackend_v20(hw_module_t *hwc_module, void *libm
 
     hwc2_compat_device_register_callback(hwc2_device, procs,
         HwComposerBackend_v20::composerSequenceId++);
-
-    for (int i = 0; i < 5 * 1000; ++i) {
-        // Wait at most 5s for hotplug events
-        if ((hwc2_primary_display =
-            hwc2_compat_device_get_display_by_id(hwc2_device, procs->primaryDisplayId)))
+    markLibrariesLoaded();
+
+    // The composer hotplugs the primary display right after registration,
+    // usually before we get here
+    int timeout = qgetenv("QPA_HWC_HOTPLUG_TIMEOUT").toInt();
+    if (timeout <= 0)
+        timeout = 5000;
+    QElapsedTimer hotplugTimer;
+    hotplugTimer.start();
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::HotplugWait);
+
+    procs->hotplugMutex.lock();
+    while (!(hwc2_primary_display =
+             hwc2_compat_device_get_display_by_id(hwc2_device, procs->primaryDisplayId))) {
+        qint64 remaining = timeout - hotplugTimer.elapsed();
+        if (remaining <= 0)
             break;
-        usleep(1000);
+        procs->hotplugCondition.wait(&procs->hotplugMutex, remaining);
     }
+    procs->hotplugMutex.unlock();
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::HotplugWait);
+
+    if (!hwc2_primary_display)
+        qWarning("QPA-HWC: no primary display hotplug after %lld ms", hotplugTimer.elapsed());
+    else
+        qDebug("Primary display %" PRIu64 " after %lld ms", procs->primaryDisplayId, hotplugTimer.elapsed());
     HWC_PLUGIN_ASSERT_NOT_NULL(hwc2_primary_display);
 
+    m_vsyncTimeline.setNominalPeriod(1000000000.0 / refreshRate());
     sleepDisplay(false);
 }
 
 HwComposerBackend_v20::~HwComposerBackend_v20()
 {
+    HwComposerFenceMonitor::instance()->removeListener(this);
+
     hwc2_compat_display_set_vsync_enabled(hwc2_primary_display, HWC2_VSYNC_DISABLE);
 
     hwc2_compat_display_set_power_mode(hwc2_primary_display, HWC2_POWER_MODE_OFF);
@@ -293,7 +216,12 @@ HwComposerBackend_v20::createWindow(int width, int height)
 
     HWC2Window *hwc_win = new HWC2Window(width, height,
                                          HAL_PIXEL_FORMAT_RGBA_8888,
-                                         hwc2_primary_display, layer);
+                                         hwc2_primary_display, layer, this);
+    HWC2DisplayConfig config;
+    if (activeConfig(&config))
+        hwc_win->setVsyncPeriod(config.vsyncPeriod);
+    hwc_win->setFrameScheduler(&m_frameScheduler);
+    m_window = hwc_win;
 
     return (EGLNativeWindowType) static_cast<ANativeWindow *>(hwc_win);
 }
@@ -304,23 +232,40 @@ HwComposerBackend_v20::destroyWindow(EGLNativeWindowType window)
     Q_UNUSED(window);
 }
 
+int
+HwComposerBackend_v20::bufferCount()
+{
+    return m_window ? m_window->bufferCount() : 0;
+}
+
 void
-HwComposerBackend_v20::swap(EGLNativeDisplayType display, EGLSurface surface)
+HwComposerBackend_v20::setSwapVsyncDivisor(int divisor)
 {
-#ifdef QPA_HWC_TIMING
-    timer.start();
-#endif
+    if (m_window)
+        m_window->setVsyncDivisor(divisor);
+}
 
-    eglSwapBuffers(display, surface);
+bool
+HwComposerBackend_v20::displayBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                                     HwComposerFenceMonitor::Listener *releaseListener, int releaseId)
+{
+    if (!m_window || m_displayOff)
+        return false;
+
+    return m_window->presentClientBuffer(buffer, acquireFenceFd, releaseListener, releaseId);
+}
+
+void
+HwComposerBackend_v20::cancelBufferRelease(HwComposerFenceMonitor::Listener *releaseListener)
+{
+    if (m_window)
+        m_window->cancelBufferRelease(releaseListener);
+}
 
-#ifdef QPA_HWC_TIMING
-    qDebug("HWComposerBackend::swap(), present=%.3f, sync=%.3f, prepare=%.3f, set=%.3f, total=%.3f",
-           presentTime / 1000000.0,
-           (syncTime - presentTime) / 1000000.0,
-           (prepareTime - syncTime) / 1000000.0,
-           (setTime - prepareTime) / 1000000.0,
-           timer.nsecsElapsed() / 1000000.0);
-#endif
+void
+HwComposerBackend_v20::swap(EGLNativeDisplayType display, EGLSurface surface)
+{
+    eglSwapBuffers(display, surface);
 }
 
 void
@@ -328,28 +273,54 @@ HwComposerBackend_v20::sleepDisplay(bool sleep)
 {
     m_displayOff = sleep;
     if (sleep) {
-        // Stop the timer so we don't end up calling into eventControl after the
-        // screen has been turned off. Doing so leads to logcat errors being
-        // logged.
-        m_vsyncTimeout.stop();
-        hwc2_compat_display_set_vsync_enabled(hwc2_primary_display, HWC2_VSYNC_DISABLE);
+        // Let the present thread finish queued frames before powering off
+        if (m_window)
+            m_window->waitForPresent();
 
+        // Present fences of a powered off display are no use for throttling
+        HwComposerFenceMonitor::instance()->removeListener(this);
+
+        suspendVsync();
         hwc2_compat_display_set_power_mode(hwc2_primary_display, HWC2_POWER_MODE_OFF);
+
+        // No later frame comes to release the client buffer left on screen
+        if (m_window)
+            m_window->displayOff();
     } else {
         hwc2_compat_display_set_power_mode(hwc2_primary_display, HWC2_POWER_MODE_ON);
 
-        // If we have pending updates, make sure those start happening now..
-        if (m_pendingUpdate.size()) {
-            hwc2_compat_display_set_vsync_enabled(hwc2_primary_display, HWC2_VSYNC_ENABLE);
-            m_vsyncTimeout.start(50, this);
-        }
+        // The composer may have dropped its layer state while powered off
+        if (m_window)
+            m_window->invalidateLayerState();
+
+        resumeVsync();
+    }
+}
+
+bool HwComposerBackend_v20::activeConfig(HWC2DisplayConfig *config)
+{
+    QMutexLocker locker(&m_configMutex);
+    if (!m_haveActiveConfig) {
+        HWC2DisplayConfig *active = hwc2_primary_display ?
+            hwc2_compat_display_get_active_config(hwc2_primary_display) : NULL;
+        if (!active)
+            return false;
+        m_activeConfig = *active;
+        m_haveActiveConfig = true;
     }
+
+    *config = m_activeConfig;
+    return true;
 }
 
 float
 HwComposerBackend_v20::refreshRate()
 {
-    float value = (float)hwc2_compat_display_get_active_config(hwc2_primary_display)->vsyncPeriod;
+    HWC2DisplayConfig config;
+    if (!activeConfig(&config))
+        return 60.0;
+
+    float value = (float)config.vsyncPeriod;
 
     value = (1000000000.0 / value);
 
@@ -357,19 +328,35 @@ HwComposerBackend_v20::refreshRate()
     return (value > 0 && value <= 1000.0) ? value : 60.0;
 }
 
+QVector<HwComposerDisplayMode> HwComposerBackend_v20::displayModes()
+{
+    // The compat layer only exposes the active config, and no way to set
+    // another one
+    QVector<HwComposerDisplayMode> modes;
+    HWC2DisplayConfig config;
+    if (activeConfig(&config)) {
+        HwComposerDisplayMode mode;
+        mode.width = config.width;
+        mode.height = config.height;
+        mode.refreshRate = refreshRate();
+        modes.append(mode);
+    }
+    return modes;
+}
+
 bool
 HwComposerBackend_v20::getScreenSizes(int *width, int *height, float *physical_width, float *physical_height)
 {
-    HWC2DisplayConfig *config = hwc2_compat_display_get_active_config(hwc2_primary_display);
+    HWC2DisplayConfig config;
 
     // should not happen
-    if (!config) return false;
+    if (!activeConfig(&config)) return false;
 
-    int dpi_x = config->dpiX;
-    int dpi_y = config->dpiY;
+    int dpi_x = config.dpiX;
+    int dpi_y = config.dpiY;
 
-    *width = config->width;
-    *height = config->height;
+    *width = config.width;
+    *height = config.height;
 
     if (dpi_x == 0 || dpi_y == 0 || *width == 0 || *height == 0) {
         qWarning() << "failed to read screen size from hwc1.x backend";
@@ -382,50 +369,46 @@ HwComposerBackend_v20::getScreenSizes(int *width, int *height, float *physical_w
     return true;
 }
 
-void HwComposerBackend_v20::timerEvent(QTimerEvent *e)
-{
-    if (e->timerId() == m_vsyncTimeout.timerId()) {
-        hwc2_compat_display_set_vsync_enabled(hwc2_primary_display, HWC2_VSYNC_DISABLE);
-        m_vsyncTimeout.stop();
-        // When waking up, we might get here as a result of requesting vsync events
-        // before the hwc is up and running. If we're timing out while still waiting
-        // for vsync to occur, trigger the update so we don't block the UI.
-        if (!m_pendingUpdate.isEmpty())
-            handleVSyncEvent();
-    } else if (e->timerId() == m_deliverUpdateTimeout.timerId()) {
-        m_deliverUpdateTimeout.stop();
-        handleVSyncEvent();
-    }
-}
-
 bool HwComposerBackend_v20::event(QEvent *e)
 {
-    if (e->type() == QEvent::User) {
-        static int idleTime = qBound(5, qgetenv("QPA_HWC_IDLE_TIME").toInt(), 100);
-        if (!m_deliverUpdateTimeout.isActive())
-            m_deliverUpdateTimeout.start(idleTime, this);
+    if (e->type() == FenceSignaledEvent) {
+        if (hasPendingUpdates())
+            deliverPendingUpdates();
         return true;
     }
     return QObject::event(e);
 }
 
-void HwComposerBackend_v20::handleVSyncEvent()
+void HwComposerBackend_v20::fenceSignaled(int, qint64 timestamp)
 {
-    QSystraceEvent trace("graphics", "QPA::handleVsync");
-    QSet<QWindow *> pendingWindows = m_pendingUpdate;
-    m_pendingUpdate.clear();
-    foreach (QWindow *w, pendingWindows) {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 12, 0))
-        QPlatformWindow *platformWindow = w->handle();
-        if (!platformWindow)
-            continue;
-
-        platformWindow->deliverUpdateRequest();
-#else
-        QWindowPrivate *wp = (QWindowPrivate *) QWindowPrivate::get(w);
-        wp->deliverUpdateRequest();
-#endif
-    }
+    HwComposerStartupTimeline::mark(HwComposerStartupTimeline::FirstPresentFence, timestamp);
+
+    // The fences signal on vsync, so they show whether the model drifted
+    if (m_softwareVsync)
+        m_softwareVsync->presentFenceSignaled(timestamp);
+
+    // Only wake up the GUI thread if an update is held back by this fence
+    if (m_waitingForFence.testAndSetOrdered(1, 0))
+        QCoreApplication::postEvent(this, new QEvent(FenceSignaledEvent));
+}
+
+bool HwComposerBackend_v20::throttleUpdates()
+{
+    // Allow one frame in flight, like waiting on the previous present fence
+    // after presenting did. Held back updates are delivered from event()
+    // once the present fence signals.
+    HwComposerFenceMonitor *monitor = HwComposerFenceMonitor::instance();
+    if (monitor->pendingCount(this) <= 1)
+        return false;
+
+    m_waitingForFence.storeRelease(1);
+
+    // The fence may have signaled before we raised the flag
+    if (monitor->pendingCount(this) > 1)
+        return true;
+
+    m_waitingForFence.storeRelease(0);
+    return false;
 }
 
 bool HwComposerBackend_v20::requestUpdate(QEglFSWindow *window)
@@ -434,21 +417,24 @@ bool HwComposerBackend_v20::requestUpdate(QEglFSWindow *window)
     if (m_displayOff)
         return false;
 
-    if (m_vsyncTimeout.isActive()) {
-        m_vsyncTimeout.stop();
-    } else {
-        hwc2_compat_display_set_vsync_enabled(hwc2_primary_display, HWC2_VSYNC_ENABLE);
-    }
-    m_vsyncTimeout.start(50, this);
-    m_pendingUpdate.insert(window->window());
+    scheduleUpdate(window->window());
     return true;
 }
 
+void HwComposerBackend_v20::setHardwareVsyncEnabled(bool enabled)
+{
+    hwc2_compat_display_set_vsync_enabled(hwc2_primary_display,
+                                          enabled ? HWC2_VSYNC_ENABLE : HWC2_VSYNC_DISABLE);
+}
+
 void HwComposerBackend_v20::onHotplugReceived(int32_t /*sequenceId*/,
                                         hwc2_display_t display, bool connected,
                                         bool /*primaryDisplay*/)
 {
     hwc2_compat_device_on_hotplug(hwc2_device, display, connected);
+
+    QMutexLocker locker(&m_configMutex);
+    m_haveActiveConfig = false;
 }
 
 // #endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
@@ -45,18 +45,22 @@
 #ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
 
 #include "hwcomposer_backend.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_vsyncnotifier.h"
+#include "hwcomposer_softwarevsync.h"
 // libhybris access to the native hwcomposer window
 #include <hwcomposer_window.h>
 
 #include <hybris/hwc2/hwc2_compatibility_layer.h>
 
 #include <QObject>
-#include <QBasicTimer>
+#include <QAtomicInt>
+#include <QMutex>
 
 class HwcProcs_v20;
-class QWindow;
+class HWC2Window;
 
-class HwComposerBackend_v20 : public QObject, public HwComposerBackend {
+class HwComposerBackend_v20 : public QObject, public HwComposerBackend, public HwComposerFenceMonitor::Listener {
 public:
     HwComposerBackend_v20(hw_module_t *hwc_module, void *libminisf);
     virtual ~HwComposerBackend_v20();
@@ -65,31 +69,55 @@ public:
     virtual EGLNativeWindowType createWindow(int width, int height);
     virtual void destroyWindow(EGLNativeWindowType window);
     virtual void swap(EGLNativeDisplayType display, EGLSurface surface);
+    virtual bool displayBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                               HwComposerFenceMonitor::Listener *releaseListener, int releaseId) Q_DECL_OVERRIDE;
+    virtual void cancelBufferRelease(HwComposerFenceMonitor::Listener *releaseListener) Q_DECL_OVERRIDE;
+    virtual int bufferCount() Q_DECL_OVERRIDE;
+    virtual void setSwapVsyncDivisor(int divisor) Q_DECL_OVERRIDE;
+    virtual QVector<HwComposerDisplayMode> displayModes() Q_DECL_OVERRIDE;
+    virtual int activeDisplayMode() Q_DECL_OVERRIDE { return 0; }
     virtual void sleepDisplay(bool sleep);
     virtual float refreshRate();
     virtual bool getScreenSizes(int *width, int *height, float *physical_width, float *physical_height);
 
     virtual bool requestUpdate(QEglFSWindow *window) Q_DECL_OVERRIDE;
+    virtual QObject *object() Q_DECL_OVERRIDE { return this; }
 
-    void timerEvent(QTimerEvent *) Q_DECL_OVERRIDE;
-    void handleVSyncEvent();
     bool event(QEvent *e) Q_DECL_OVERRIDE;
 
+    void fenceSignaled(int id, qint64 timestamp) Q_DECL_OVERRIDE;
+
+    HwComposerVsyncNotifier *vsyncNotifier() const { return m_vsyncNotifier; }
+
     void onHotplugReceived(int32_t sequenceId, hwc2_display_t display,
                            bool connected, bool primaryDisplay);
 
     static int composerSequenceId;
 
+protected:
+    void setHardwareVsyncEnabled(bool enabled) Q_DECL_OVERRIDE;
+    bool throttleUpdates() Q_DECL_OVERRIDE;
+
 private:
+    static const QEvent::Type FenceSignaledEvent = QEvent::Type(QEvent::User + 1);
+
+    // Copy of the active config, only asked from the composer again after
+    // a hotplug
+    bool activeConfig(HWC2DisplayConfig *config);
+
     hwc2_compat_device_t* hwc2_device;
     hwc2_compat_display_t* hwc2_primary_display;
     hwc2_compat_layer_t* hwc2_primary_layer;
 
     bool m_displayOff;
-    QBasicTimer m_deliverUpdateTimeout;
-    QBasicTimer m_vsyncTimeout;
-    QSet<QWindow *> m_pendingUpdate;
     HwcProcs_v20 *procs;
+    HWC2Window *m_window;
+    QAtomicInt m_waitingForFence;
+    HwComposerVsyncNotifier *m_vsyncNotifier;
+
+    QMutex m_configMutex;
+    HWC2DisplayConfig m_activeConfig;
+    bool m_haveActiveConfig;
 };
 
 #endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
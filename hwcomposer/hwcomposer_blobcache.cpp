@@ -0,0 +1,396 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_blobcache.h"
+#include "hwcomposer_probecache.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+#include <private/qcore_unix_p.h>
+
+#include <EGL/eglext.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+static const quint32 HWC_PLUGIN_BLOB_CACHE_MAGIC = 0x51484342; /* "QHCB" */
+static const quint32 HWC_PLUGIN_BLOB_CACHE_VERSION = 2;
+
+// Entries follow the header as EntryHeader, key, value, from least to
+// most recently used
+struct HwComposerBlobCacheHeader {
+    quint32 magic;
+    quint32 version;
+    char fingerprint[256];
+    quint32 count;
+    quint32 reserved;
+};
+
+struct HwComposerBlobCacheEntryHeader {
+    quint32 keySize;
+    quint32 valueSize;
+};
+
+Q_GLOBAL_STATIC(HwComposerBlobCache, blobCache)
+
+HwComposerBlobCache *HwComposerBlobCache::instance()
+{
+    return blobCache();
+}
+
+#ifdef EGL_ANDROID_blob_cache
+static void setBlob(const void *key, EGLsizeiANDROID keySize, const void *value, EGLsizeiANDROID valueSize)
+{
+    HwComposerBlobCache::instance()->set(key, keySize, value, valueSize);
+}
+
+static EGLsizeiANDROID getBlob(const void *key, EGLsizeiANDROID keySize, void *value, EGLsizeiANDROID valueSize)
+{
+    return HwComposerBlobCache::instance()->get(key, keySize, value, valueSize);
+}
+#endif
+
+void HwComposerBlobCache::install(EGLDisplay display)
+{
+#ifdef EGL_ANDROID_blob_cache
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_ANDROID_blob_cache"))
+        return;
+
+    PFNEGLSETBLOBCACHEFUNCSANDROIDPROC setBlobCacheFuncs =
+        (PFNEGLSETBLOBCACHEFUNCSANDROIDPROC)eglGetProcAddress("eglSetBlobCacheFuncsANDROID");
+    if (!setBlobCacheFuncs)
+        return;
+
+    // Binaries of another driver are of no use
+    QByteArray fingerprint = QByteArray(eglQueryString(display, EGL_VENDOR)) + ' ' +
+                             QByteArray(eglQueryString(display, EGL_VERSION)) + ' ' +
+                             HwComposerProbeCache::buildFingerprint();
+    if (!instance()->open(fingerprint))
+        return;
+
+    setBlobCacheFuncs(display, setBlob, getBlob);
+#else
+    Q_UNUSED(display);
+#endif
+}
+
+// Writes the cache once the driver stops storing, programs tend to come
+// in bursts when a new scene shows up
+class HwComposerBlobCacheWriter : public QThread
+{
+public:
+    explicit HwComposerBlobCacheWriter(HwComposerBlobCache *cache)
+        : m_cache(cache)
+    {
+        setObjectName(QStringLiteral("QPA-HWC-blobcache"));
+    }
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        QMutexLocker locker(&m_cache->m_mutex);
+        while (m_cache->m_dirty) {
+            if (!m_cache->m_flushRequested && m_cache->m_changed.wait(&m_cache->m_mutex, 2000))
+                continue;
+
+            QVector<QPair<QByteArray, QByteArray> > entries = m_cache->snapshotLocked();
+            m_cache->m_dirty = false;
+            m_cache->m_flushRequested = false;
+
+            locker.unlock();
+            m_cache->write(entries);
+            locker.relock();
+        }
+        m_cache->m_writerActive = false;
+    }
+
+private:
+    HwComposerBlobCache *m_cache;
+};
+
+HwComposerBlobCache::HwComposerBlobCache()
+    : m_maxSize(4096 * 1024)
+    , m_map(NULL)
+    , m_mapSize(0)
+    , m_size(0)
+    , m_clock(0)
+    , m_dirty(false)
+    , m_flushRequested(false)
+    , m_writer(new HwComposerBlobCacheWriter(this))
+    , m_writerActive(false)
+{
+    QByteArray size = qgetenv("QPA_HWC_BLOB_CACHE_SIZE");
+    if (!size.isEmpty())
+        m_maxSize = qMax(0LL, size.toLongLong()) * 1024;
+
+    m_path = qgetenv("QPA_HWC_BLOB_CACHE_FILE");
+    if (m_path.isEmpty()) {
+        m_path = QFile::encodeName(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) +
+                                   QStringLiteral("/qpa-hwcomposer/egl-blob-cache"));
+    }
+}
+
+HwComposerBlobCache::~HwComposerBlobCache()
+{
+    flush();
+    delete m_writer;
+
+    m_entries.clear();
+    if (m_map)
+        munmap(m_map, m_mapSize);
+}
+
+bool HwComposerBlobCache::open(const QByteArray &fingerprint)
+{
+    if (m_maxSize <= 0)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_fingerprint = fingerprint.left(sizeof(((HwComposerBlobCacheHeader *)0)->fingerprint) - 1);
+
+    int fd = qt_safe_open(m_path.constData(), O_RDONLY);
+    if (fd == -1)
+        return true;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= qint64(sizeof(HwComposerBlobCacheHeader))) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            m_map = static_cast<uchar *>(map);
+            m_mapSize = st.st_size;
+        }
+    }
+    qt_safe_close(fd);
+    if (!m_map)
+        return true;
+
+    HwComposerBlobCacheHeader header;
+    memcpy(&header, m_map, sizeof(header));
+    if (header.magic != HWC_PLUGIN_BLOB_CACHE_MAGIC ||
+        header.version != HWC_PLUGIN_BLOB_CACHE_VERSION ||
+        strncmp(header.fingerprint, m_fingerprint.constData(), sizeof(header.fingerprint)) != 0)
+        return true;
+
+    // Keys and values stay in the mapping, a bad entry ends the list
+    qint64 offset = sizeof(header);
+    for (quint32 i = 0; i < header.count; i++) {
+        HwComposerBlobCacheEntryHeader entry;
+        if (m_mapSize - offset < qint64(sizeof(entry)))
+            break;
+        memcpy(&entry, m_map + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (m_mapSize - offset < qint64(entry.keySize) + entry.valueSize)
+            break;
+
+        QByteArray key = QByteArray::fromRawData(reinterpret_cast<const char *>(m_map + offset), entry.keySize);
+        offset += entry.keySize;
+        Entry &cached = m_entries[key];
+        cached.value = QByteArray::fromRawData(reinterpret_cast<const char *>(m_map + offset), entry.valueSize);
+        cached.lastUse = ++m_clock;
+        offset += entry.valueSize;
+        m_size += qint64(entry.keySize) + entry.valueSize;
+    }
+
+    // A smaller limit than last time
+    evictLocked(0);
+    return true;
+}
+
+void HwComposerBlobCache::set(const void *key, qint64 keySize, const void *value, qint64 valueSize)
+{
+    // One entry shouldn't push out most of the others
+    if (keySize <= 0 || valueSize <= 0 || keySize + valueSize > m_maxSize / 4)
+        return;
+
+    QByteArray newKey(static_cast<const char *>(key), keySize);
+    QByteArray newValue(static_cast<const char *>(value), valueSize);
+
+    QMutexLocker locker(&m_mutex);
+    QHash<QByteArray, Entry>::iterator it = m_entries.find(newKey);
+    if (it != m_entries.end()) {
+        if (it->value == newValue) {
+            it->lastUse = ++m_clock;
+            return;
+        }
+        m_size -= it.key().size() + it->value.size();
+        m_entries.erase(it);
+    }
+
+    evictLocked(keySize + valueSize);
+    Entry &entry = m_entries[newKey];
+    entry.value = newValue;
+    entry.lastUse = ++m_clock;
+    m_size += keySize + valueSize;
+
+    m_dirty = true;
+    m_changed.wakeAll();
+    bool startWriter = !m_writerActive;
+    m_writerActive = true;
+    locker.unlock();
+
+    if (startWriter) {
+        // The last run may just be returning
+        m_writer->wait();
+        m_writer->start(QThread::LowestPriority);
+    }
+}
+
+qint64 HwComposerBlobCache::get(const void *key, qint64 keySize, void *value, qint64 valueSize)
+{
+    if (keySize <= 0)
+        return 0;
+
+    QByteArray lookupKey = QByteArray::fromRawData(static_cast<const char *>(key), keySize);
+
+    QMutexLocker locker(&m_mutex);
+    QHash<QByteArray, Entry>::iterator it = m_entries.find(lookupKey);
+    if (it == m_entries.end())
+        return 0;
+
+    // Drivers ask for the size first
+    it->lastUse = ++m_clock;
+    qint64 size = it->value.size();
+    if (value && size <= valueSize)
+        memcpy(value, it->value.constData(), size);
+    return size;
+}
+
+void HwComposerBlobCache::evictLocked(qint64 needed)
+{
+    while (!m_entries.isEmpty() && m_size + needed > m_maxSize) {
+        QHash<QByteArray, Entry>::iterator oldest = m_entries.begin();
+        for (QHash<QByteArray, Entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->lastUse < oldest->lastUse)
+                oldest = it;
+        }
+        m_size -= oldest.key().size() + oldest->value.size();
+        m_entries.erase(oldest);
+        m_dirty = true;
+    }
+}
+
+static bool lessRecentlyUsed(const QPair<quint64, QPair<QByteArray, QByteArray> > &a,
+                             const QPair<quint64, QPair<QByteArray, QByteArray> > &b)
+{
+    return a.first < b.first;
+}
+
+QVector<QPair<QByteArray, QByteArray> > HwComposerBlobCache::snapshotLocked() const
+{
+    QVector<QPair<quint64, QPair<QByteArray, QByteArray> > > byUse;
+    byUse.reserve(m_entries.size());
+    for (QHash<QByteArray, Entry>::const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it)
+        byUse.append(qMakePair(it->lastUse, qMakePair(it.key(), it->value)));
+    std::sort(byUse.begin(), byUse.end(), lessRecentlyUsed);
+
+    QVector<QPair<QByteArray, QByteArray> > entries;
+    entries.reserve(byUse.size());
+    for (int i = 0; i < byUse.size(); i++)
+        entries.append(byUse.at(i).second);
+    return entries;
+}
+
+void HwComposerBlobCache::write(const QVector<QPair<QByteArray, QByteArray> > &entries)
+{
+    QMutexLocker locker(&m_writeMutex);
+
+    QString path = QFile::decodeName(m_path);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // Written next to the old file and renamed over it when complete
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("QPA-HWC: cannot write blob cache %s: %s", m_path.constData(),
+                 qPrintable(file.errorString()));
+        return;
+    }
+
+    HwComposerBlobCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HWC_PLUGIN_BLOB_CACHE_MAGIC;
+    header.version = HWC_PLUGIN_BLOB_CACHE_VERSION;
+    strncpy(header.fingerprint, m_fingerprint.constData(), sizeof(header.fingerprint) - 1);
+    header.count = entries.size();
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (int i = 0; i < entries.size(); i++) {
+        HwComposerBlobCacheEntryHeader entry;
+        entry.keySize = entries.at(i).first.size();
+        entry.valueSize = entries.at(i).second.size();
+        file.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+        file.write(entries.at(i).first);
+        file.write(entries.at(i).second);
+    }
+
+    if (!file.commit())
+        qWarning("QPA-HWC: cannot write blob cache %s: %s", m_path.constData(),
+                 qPrintable(file.errorString()));
+}
+
+void HwComposerBlobCache::flush()
+{
+    m_mutex.lock();
+    if (m_writerActive) {
+        m_flushRequested = true;
+        m_changed.wakeAll();
+    }
+    m_mutex.unlock();
+    m_writer->wait();
+
+    // Stored after the writer was done
+    m_mutex.lock();
+    if (!m_dirty || m_writerActive) {
+        m_mutex.unlock();
+        return;
+    }
+    QVector<QPair<QByteArray, QByteArray> > entries = snapshotLocked();
+    m_dirty = false;
+    m_mutex.unlock();
+    write(entries);
+}
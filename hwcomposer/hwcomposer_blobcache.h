@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_BLOBCACHE_H
+#define HWCOMPOSER_BLOBCACHE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QHash>
+#include <QPair>
+#include <QVector>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <EGL/egl.h>
+
+// Keeps what the GLES driver hands to EGL_ANDROID_blob_cache, mostly
+// compiled shader programs, so the next start of the process doesn't have
+// to compile them again. The file from the last run is memory-mapped and
+// its entries used in place; new entries are written out in the
+// background once the driver has been quiet for a moment, to a new file
+// that replaces the old one, so a crash never leaves a torn cache. When
+// the size limit is reached, the least recently used entries go first.
+// The file is only used with the driver and the Android build that wrote
+// it, a vendor update can change the driver without changing its version.
+//
+// QPA_HWC_BLOB_CACHE_FILE is the file, by default
+// $XDG_CACHE_HOME/qpa-hwcomposer/egl-blob-cache, and
+// QPA_HWC_BLOB_CACHE_SIZE the limit in KiB, 4096 by default, 0 turns the
+// cache off.
+class HwComposerBlobCache
+{
+public:
+    static HwComposerBlobCache *instance();
+
+    // Hand the cache to the driver, if the display has the extension
+    static void install(EGLDisplay display);
+
+    // The callbacks of the driver, on any thread
+    void set(const void *key, qint64 keySize, const void *value, qint64 valueSize);
+    qint64 get(const void *key, qint64 keySize, void *value, qint64 valueSize);
+
+    // Write pending entries out now
+    void flush();
+
+    // Load the file if it was written for fingerprint, and store new
+    // entries with it. False if the cache is turned off.
+    bool open(const QByteArray &fingerprint);
+
+    HwComposerBlobCache();
+    ~HwComposerBlobCache();
+
+private:
+    friend class HwComposerBlobCacheWriter;
+
+    struct Entry {
+        QByteArray value;
+        quint64 lastUse;
+    };
+
+    void evictLocked(qint64 needed);
+    // Entries from least to most recently used
+    QVector<QPair<QByteArray, QByteArray> > snapshotLocked() const;
+    void write(const QVector<QPair<QByteArray, QByteArray> > &entries);
+
+    QByteArray m_path;
+    QByteArray m_fingerprint;
+    qint64 m_maxSize;
+
+    // The file of the last run, entries point into it until replaced
+    uchar *m_map;
+    qint64 m_mapSize;
+
+    QMutex m_mutex;
+    QHash<QByteArray, Entry> m_entries;
+    qint64 m_size;
+    quint64 m_clock;
+    bool m_dirty;
+    bool m_flushRequested;
+
+    QWaitCondition m_changed;
+    QThread *m_writer;
+    bool m_writerActive;
+    QMutex m_writeMutex;
+};
+
+#endif /* HWCOMPOSER_BLOBCACHE_H */
@@ -0,0 +1,105 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_buffercount.h"
+
+#include <QtCore/QDebug>
+
+// Missed vsyncs within a short run of frames that make us grow
+static const int HWC_PLUGIN_GROW_MISSES = 3;
+static const int HWC_PLUGIN_MISS_WINDOW = 30;
+// Frames without a miss before shrinking, about 10 s of animation at
+// 60 Hz. Doubled (up to the max) whenever shrinking turns out to be wrong.
+static const int HWC_PLUGIN_SHRINK_FRAMES = 600;
+static const int HWC_PLUGIN_MAX_SHRINK_FRAMES = 19200;
+
+HwComposerBufferCountPolicy::HwComposerBufferCountPolicy()
+    : m_periodNs(0)
+    , m_divisor(1)
+    , m_bufferCount(2)
+    , m_misses(0)
+    , m_framesSinceMiss(0)
+    , m_framesSinceShrink(-1)
+    , m_shrinkFrames(HWC_PLUGIN_SHRINK_FRAMES)
+{
+}
+
+bool HwComposerBufferCountPolicy::isAdaptive()
+{
+    return qgetenv("QPA_HWC_BUFFER_COUNT") == "adaptive";
+}
+
+void HwComposerBufferCountPolicy::framePresented(qint64 target, qint64 timestamp)
+{
+    if (target <= 0)
+        return;
+
+    int bufferCount = m_bufferCount.loadAcquire();
+    if (bufferCount == 2 && m_framesSinceShrink >= 0 && m_framesSinceShrink < HWC_PLUGIN_MAX_SHRINK_FRAMES)
+        m_framesSinceShrink++;
+
+    qint64 slack = (qMax(m_divisor.loadAcquire(), 1) - 1) * m_periodNs.loadAcquire();
+    if (timestamp <= target + slack) {
+        m_framesSinceMiss++;
+        if (bufferCount == 3 && m_framesSinceMiss >= m_shrinkFrames) {
+            qDebug("Frames keep up with vsync, switching to double buffering");
+            m_bufferCount.storeRelease(2);
+            m_framesSinceShrink = 0;
+            m_misses = 0;
+        }
+        return;
+    }
+
+    // The frame was shown at least a vsync later than it was meant for
+    if (m_framesSinceMiss > HWC_PLUGIN_MISS_WINDOW)
+        m_misses = 0;
+    m_misses++;
+    m_framesSinceMiss = 0;
+
+    if (bufferCount == 2 && m_misses >= HWC_PLUGIN_GROW_MISSES) {
+        // Shrinking was premature, wait longer before the next attempt
+        if (m_framesSinceShrink >= 0 && m_framesSinceShrink < m_shrinkFrames)
+            m_shrinkFrames = qMin(2 * m_shrinkFrames, HWC_PLUGIN_MAX_SHRINK_FRAMES);
+
+        qDebug("Frames are missing vsync, switching to triple buffering");
+        m_bufferCount.storeRelease(3);
+        m_misses = 0;
+    }
+}
@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_BUFFERCOUNT_H
+#define HWCOMPOSER_BUFFERCOUNT_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+// Picks between double and triple buffering from how the window keeps up
+// with vsync: frames that reach the hwc after the vsync they were rendered
+// for grow the swap chain to three buffers, a long enough run without
+// misses shrinks it back to two, saving a frame of latency and a buffer of
+// memory. Only frames rendered for an update delivered on vsync are judged,
+// windows that update less often than the display refreshes don't miss
+// anything by it.
+class HwComposerBufferCountPolicy
+{
+public:
+    HwComposerBufferCountPolicy();
+
+    // Opt-in via QPA_HWC_BUFFER_COUNT=adaptive
+    static bool isAdaptive();
+
+    void setVsyncPeriod(qint64 periodNs) { m_periodNs.storeRelease(periodNs); }
+    // The next frame of a window capped to every divisor-th vsync is due
+    // that many vsyncs later, it can take until then
+    void setVsyncDivisor(int divisor) { m_divisor.storeRelease(divisor); }
+
+    // Present thread, once the hwc took a frame rendered for the vsync at
+    // target. Times are CLOCK_MONOTONIC in ns.
+    void framePresented(qint64 target, qint64 timestamp);
+
+    int bufferCount() const { return m_bufferCount.loadAcquire(); }
+
+private:
+    QAtomicInteger<qint64> m_periodNs;
+    QAtomicInt m_divisor;
+    QAtomicInt m_bufferCount;
+    int m_misses;
+    int m_framesSinceMiss;
+    // Frames since shrinking to two buffers, -1 if we never did
+    int m_framesSinceShrink;
+    int m_shrinkFrames;
+};
+
+#endif /* HWCOMPOSER_BUFFERCOUNT_H */
@@ -47,10 +47,14 @@
 #include "hwcomposer_context.h"
 
 #include "qeglfscontext.h"
+#include "qeglfswindow.h"
 #include "hwcomposer_screeninfo.h"
 #include "hwcomposer_backend.h"
+#include "hwcomposer_probecache.h"
+#include "hwcomposer_startuptimeline.h"
 
 #include <qcoreapplication.h>
+#include <qthread.h>
 
 QT_BEGIN_NAMESPACE
 
@@ -65,13 +69,22 @@ HwComposerContext::HwComposerContext()
     backend = HwComposerBackend::create();
     HWC_PLUGIN_ASSERT_NOT_NULL(backend);
 
-    fps = backend->refreshRate();
+    HwComposerProbeCache::Entry cached;
+    if (HwComposerProbeCache::instance()->lookup(&cached) && cached.refreshRate > 0)
+        fps = cached.refreshRate;
+    else
+        fps = backend->refreshRate();
 
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::ScreenInfo);
     info = new HwComposerScreenInfo(backend);
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::ScreenInfo);
 }
 
 HwComposerContext::~HwComposerContext()
 {
+    // If the first frame never made it to the screen
+    HwComposerStartupTimeline::dump();
+
     // Properly clean up hwcomposer backend
     HwComposerBackend::destroy(backend);
 
@@ -127,6 +140,7 @@ EGLNativeWindowType HwComposerContext::createNativeWindow(const QSurfaceFormat &
 
     window_created = true;
     QSize size = screenSize();
+    HwComposerStartupTimeline::Scope timing(HwComposerStartupTimeline::FirstNativeWindow);
     return backend->createWindow(size.width(), size.height());
 }
 
@@ -144,7 +158,31 @@ void HwComposerContext::swapToWindow(QEglFSContext *context, QPlatformSurface *s
 
     EGLDisplay egl_display = context->eglDisplay();
     EGLSurface egl_surface = context->eglSurfaceForPlatformSurface(surface);
-    return backend->swap(egl_display, egl_surface);
+    QEglFSWindow *window = static_cast<QEglFSWindow *>(surface);
+    backend->setSwapDamage(window->takeSwapDamage());
+    backend->setOverlayLayers(window->takeOverlayLayers());
+    backend->setSwapVsyncDivisor(window->vsyncDivisor());
+    backend->swap(egl_display, egl_surface);
+
+    // Swaps happen on the render thread
+    if (first_swap_receiver.loadAcquire()) {
+        if (QObject *receiver = first_swap_receiver.fetchAndStoreOrdered(NULL))
+            QCoreApplication::postEvent(receiver, new QEvent(QEvent::User), Qt::LowEventPriority);
+    }
+}
+
+bool HwComposerContext::displayBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                                      HwComposerFenceMonitor::Listener *releaseListener, int releaseId)
+{
+    if (display_off)
+        return false;
+
+    return backend->displayBuffer(buffer, acquireFenceFd, releaseListener, releaseId);
+}
+
+void HwComposerContext::cancelBufferRelease(HwComposerFenceMonitor::Listener *releaseListener)
+{
+    backend->cancelBufferRelease(releaseListener);
 }
 
 void HwComposerContext::sleepDisplay(bool sleep)
@@ -165,6 +203,64 @@ qreal HwComposerContext::refreshRate() const
     return fps;
 }
 
+int HwComposerContext::bufferCount() const
+{
+    return backend->bufferCount();
+}
+
+void HwComposerContext::moveToThread(QThread *thread)
+{
+    backend->handOverToThread(thread);
+}
+
+void HwComposerContext::setFirstSwapReceiver(QObject *receiver)
+{
+    first_swap_receiver.storeRelease(receiver);
+}
+
+void HwComposerContext::verifyProbeCache()
+{
+    HwComposerProbeCache::instance()->verify(backend);
+}
+
+HwComposerVsyncTimeline *HwComposerContext::vsyncTimeline() const
+{
+    return backend->vsyncTimeline();
+}
+
+QVector<QPair<QSize, qreal> > HwComposerContext::displayModes() const
+{
+    QVector<QPair<QSize, qreal> > modes;
+    foreach (const HwComposerDisplayMode &mode, backend->displayModes())
+        modes.append(qMakePair(QSize(mode.width, mode.height), qreal(mode.refreshRate)));
+    return modes;
+}
+
+int HwComposerContext::activeDisplayMode() const
+{
+    return backend->activeDisplayMode();
+}
+
+bool HwComposerContext::setActiveDisplayMode(int index)
+{
+    // The window and its buffers keep their size, only the refresh rate
+    // may change
+    QVector<HwComposerDisplayMode> modes = backend->displayModes();
+    if (index < 0 || index >= modes.size())
+        return false;
+    if (QSize(modes.at(index).width, modes.at(index).height) != screenSize()) {
+        qWarning("QPA-HWC: not switching to display mode %d, its size differs", index);
+        return false;
+    }
+
+    if (!backend->setActiveDisplayMode(index))
+        return false;
+
+    fps = backend->refreshRate();
+    qDebug("Display mode %d active, %.2f Hz", index, fps);
+    return true;
+}
+
 bool HwComposerContext::requestUpdate(QEglFSWindow *window)
 {
     if (backend)
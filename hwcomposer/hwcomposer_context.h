@@ -53,6 +53,9 @@
 #include <qpa/qplatformscreen.h>
 #include <QtGui/QSurfaceFormat>
 #include <QtGui/QImage>
+#include <QtCore/QVector>
+#include <QtCore/QPair>
+#include <QtCore/QAtomicPointer>
 #include <EGL/egl.h>
 
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
@@ -63,12 +66,18 @@
 #include <QtPlatformSupport/private/qeglplatformcontext_p.h>
 #endif
 
+#include "hwcomposer_fencemonitor.h"
+
+struct ANativeWindowBuffer;
+
 QT_BEGIN_NAMESPACE
 
 class QEglFSContext;
 class QEglFSWindow;
 class HwComposerScreenInfo;
 class HwComposerBackend;
+class HwComposerVsyncTimeline;
+class QThread;
 
 class HwComposerContext
 {
@@ -87,18 +96,38 @@ public:
     void destroyNativeWindow(EGLNativeWindowType window);
 
     void swapToWindow(QEglFSContext *context, QPlatformSurface *surface);
+    bool displayBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                       HwComposerFenceMonitor::Listener *releaseListener, int releaseId);
+    void cancelBufferRelease(HwComposerFenceMonitor::Listener *releaseListener);
 
     void sleepDisplay(bool sleep);
     qreal refreshRate() const;
+    int bufferCount() const;
+    HwComposerVsyncTimeline *vsyncTimeline() const;
+
+    // Display configs as (size, refresh rate), -1 if unknown
+    QVector<QPair<QSize, qreal> > displayModes() const;
+    int activeDisplayMode() const;
+    bool setActiveDisplayMode(int index);
 
     bool requestUpdate(QEglFSWindow *window);
 
+    // Hand the context over to another thread after creating it
+    void moveToThread(QThread *thread);
+
+    // receiver gets a QEvent::User of low priority after the first swap
+    void setFirstSwapReceiver(QObject *receiver);
+
+    // Check the display values start-up took from the probe cache
+    void verifyProbeCache();
+
 private:
     HwComposerScreenInfo *info;
     HwComposerBackend *backend;
     bool display_off;
     bool window_created;
     qreal fps;
+    QAtomicPointer<QObject> first_swap_receiver;
 };
 
 QT_END_NAMESPACE
@@ -0,0 +1,271 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_fbvsync.h"
+#include "hwcomposer_vsynctimeline.h"
+#include "hwcomposer_vsyncnotifier.h"
+#include "hwcomposer_fencemonitor.h"
+
+#include <QtCore/qglobal.h>
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QAtomicInt>
+#include <private/qcore_unix_p.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+
+#ifndef FBIO_WAITFORVSYNC
+#define FBIO_WAITFORVSYNC _IOW('F', 0x20, __u32)
+#endif
+
+// How long shutting down waits for the thread. FBIO_WAITFORVSYNC can't be
+// woken up, and blocks for good on some drivers once the panel is off.
+static const unsigned long HWC_FB_VSYNC_QUIT_TIMEOUT_MS = 500;
+
+class HwComposerFbVsyncThread : public QThread
+{
+public:
+    HwComposerFbVsyncThread(HwComposerVsyncTimeline *timeline, HwComposerVsyncNotifier *notifier);
+    ~HwComposerFbVsyncThread();
+
+    // Stop delivering, the timeline and notifier may go away after this
+    void quit();
+
+    QAtomicInt m_available;
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    bool m_enabled;
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    bool waitSysfs(qint64 *timestamp);
+    bool waitIoctl(qint64 *timestamp);
+
+    HwComposerVsyncTimeline *m_timeline;
+    HwComposerVsyncNotifier *m_notifier;
+    bool m_quit;
+
+    int m_eventFd;
+    int m_fbFd;
+    int m_wakeFd;
+};
+
+HwComposerFbVsyncThread::HwComposerFbVsyncThread(HwComposerVsyncTimeline *timeline, HwComposerVsyncNotifier *notifier)
+    : m_available(1)
+    , m_enabled(false)
+    , m_timeline(timeline)
+    , m_notifier(notifier)
+    , m_quit(false)
+    , m_eventFd(qt_safe_open("/sys/class/graphics/fb0/vsync_event", O_RDONLY))
+    , m_fbFd(-1)
+    , m_wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    if (m_eventFd == -1) {
+        m_fbFd = qt_safe_open("/dev/fb0", O_RDWR);
+        if (m_fbFd == -1) {
+            qWarning("QPA-HWC: no framebuffer vsync source: %s", strerror(errno));
+            m_available.storeRelease(0);
+            return;
+        }
+    }
+
+    setObjectName(QStringLiteral("QPA-HWC-vsync"));
+    start(QThread::TimeCriticalPriority);
+}
+
+HwComposerFbVsyncThread::~HwComposerFbVsyncThread()
+{
+    if (m_eventFd != -1)
+        qt_safe_close(m_eventFd);
+    if (m_fbFd != -1)
+        qt_safe_close(m_fbFd);
+    if (m_wakeFd != -1)
+        close(m_wakeFd);
+}
+
+void HwComposerFbVsyncThread::quit()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_cond.wakeAll();
+    m_mutex.unlock();
+
+    uint64_t one = 1;
+    if (m_wakeFd != -1 && write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+        qWarning("QPA-HWC: could not wake up vsync thread");
+}
+
+bool HwComposerFbVsyncThread::waitSysfs(qint64 *timestamp)
+{
+    // The node signals POLLPRI on each vsync and reads "VSYNC=<ns>"
+    struct pollfd fds[2];
+    fds[0].fd = m_eventFd;
+    fds[0].events = POLLPRI;
+    fds[1].fd = m_wakeFd;
+    fds[1].events = POLLIN;
+
+    int res = poll(fds, m_wakeFd != -1 ? 2 : 1, 100);
+    if (res < 0 && errno != EINTR) {
+        qWarning("QPA-HWC: polling vsync_event failed: %s", strerror(errno));
+        return false;
+    }
+
+    if (res > 0 && (fds[0].revents & (POLLPRI | POLLERR))) {
+        char buf[64];
+        ssize_t len = pread(m_eventFd, buf, sizeof(buf) - 1, 0);
+        if (len > 0) {
+            buf[len] = '\0';
+            const char *value = strchr(buf, '=');
+            *timestamp = strtoll(value ? value + 1 : buf, NULL, 10);
+        }
+        // Some kernels report 0, then now is as good as it gets
+        if (*timestamp <= 0)
+            *timestamp = HwComposerFenceMonitor::now();
+    }
+    return true;
+}
+
+bool HwComposerFbVsyncThread::waitIoctl(qint64 *timestamp)
+{
+    __u32 crtc = 0;
+    if (ioctl(m_fbFd, FBIO_WAITFORVSYNC, &crtc) == -1) {
+        if (errno == EINTR)
+            return true;
+        qWarning("QPA-HWC: FBIO_WAITFORVSYNC failed: %s", strerror(errno));
+        return false;
+    }
+
+    *timestamp = HwComposerFenceMonitor::now();
+    return true;
+}
+
+void HwComposerFbVsyncThread::run()
+{
+    // Polls without an event in a row, while enabled
+    int idlePolls = 0;
+
+    for (;;) {
+        m_mutex.lock();
+        if (!m_enabled)
+            idlePolls = 0;
+        while (!m_enabled && !m_quit)
+            m_cond.wait(&m_mutex);
+        bool quit = m_quit;
+        m_mutex.unlock();
+        if (quit)
+            break;
+
+        qint64 timestamp = 0;
+        bool ok = m_eventFd != -1 ? waitSysfs(&timestamp) : waitIoctl(&timestamp);
+
+        // Delivering under the lock, quit() returns only once we are done
+        // with the timeline and the notifier
+        QMutexLocker locker(&m_mutex);
+        if (m_quit)
+            break;
+        if (!ok) {
+            m_available.storeRelease(0);
+            // Don't leave pending updates waiting on us
+            m_notifier->notify(HwComposerFenceMonitor::now());
+            break;
+        }
+
+        if (timestamp) {
+            idlePolls = 0;
+            m_timeline->addVsync(timestamp);
+            m_notifier->notify(timestamp);
+        } else if (m_eventFd != -1 && ++idlePolls == 3) {
+            // Some drivers only fill vsync_event once vsync got enabled
+            // through a vendor ioctl, fall back to waiting on the fb
+            m_fbFd = qt_safe_open("/dev/fb0", O_RDWR);
+            if (m_fbFd != -1) {
+                qWarning("QPA-HWC: no events on vsync_event, using FBIO_WAITFORVSYNC");
+                qt_safe_close(m_eventFd);
+                m_eventFd = -1;
+            }
+        }
+    }
+}
+
+HwComposerFbVsync::HwComposerFbVsync(HwComposerVsyncTimeline *timeline, HwComposerVsyncNotifier *notifier)
+    : m_thread(new HwComposerFbVsyncThread(timeline, notifier))
+{
+}
+
+HwComposerFbVsync::~HwComposerFbVsync()
+{
+    m_thread->quit();
+    if (m_thread->wait(HWC_FB_VSYNC_QUIT_TIMEOUT_MS)) {
+        delete m_thread;
+        return;
+    }
+
+    // Stuck in the ioctl. It no longer touches anything of ours, let it go
+    // away on its own whenever it returns.
+    qWarning("QPA-HWC: vsync thread did not return from FBIO_WAITFORVSYNC in %lu ms, leaving it behind",
+             HWC_FB_VSYNC_QUIT_TIMEOUT_MS);
+    QObject::connect(m_thread, &QThread::finished, m_thread, &QObject::deleteLater);
+    if (m_thread->isFinished())
+        delete m_thread;
+}
+
+bool HwComposerFbVsync::isAvailable() const
+{
+    return m_thread->m_available.loadAcquire();
+}
+
+void HwComposerFbVsync::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_thread->m_mutex);
+    m_thread->m_enabled = enabled;
+    if (enabled)
+        m_thread->m_cond.wakeAll();
+}
@@ -0,0 +1,69 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_FBVSYNC_H
+#define HWCOMPOSER_FBVSYNC_H
+
+class HwComposerVsyncTimeline;
+class HwComposerVsyncNotifier;
+class HwComposerFbVsyncThread;
+
+// Vsync source for hwcomposer 0.x, which has no vsync callback. A helper
+// thread waits for vsync on the framebuffer device while enabled, either
+// on the vsync_event sysfs node of fb0 (timestamps from the kernel) or,
+// where that is missing, with the FBIO_WAITFORVSYNC ioctl, and feeds the
+// events to the timeline and notifier the way the hwc callbacks do.
+class HwComposerFbVsync
+{
+public:
+    HwComposerFbVsync(HwComposerVsyncTimeline *timeline, HwComposerVsyncNotifier *notifier);
+    ~HwComposerFbVsync();
+
+    // False once no way to wait for vsync was found, updates should then
+    // be timed by Qt instead
+    bool isAvailable() const;
+
+    void setEnabled(bool enabled);
+
+private:
+    HwComposerFbVsyncThread *m_thread;
+};
+
+#endif /* HWCOMPOSER_FBVSYNC_H */
@@ -0,0 +1,294 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_fencemonitor.h"
+
+#include <QtCore/qglobal.h>
+
+#include <sync/sync.h>
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+Q_GLOBAL_STATIC(HwComposerFenceMonitor, fenceMonitor)
+
+HwComposerFenceMonitor *HwComposerFenceMonitor::instance()
+{
+    return fenceMonitor();
+}
+
+HwComposerFenceMonitor::HwComposerFenceMonitor()
+    : m_epollFd(epoll_create1(EPOLL_CLOEXEC))
+    , m_wakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    , m_polledCount(0)
+    , m_serial(0)
+    , m_lastSignalTime(0)
+    , m_quit(false)
+{
+    if (m_epollFd == -1 || m_wakeFd == -1)
+        qFatal("QPA-HWC: could not create fence monitor: %s", strerror(errno));
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = quint64(m_wakeFd);
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+
+    setObjectName(QStringLiteral("QPA-HWC-fences"));
+    start();
+}
+
+HwComposerFenceMonitor::~HwComposerFenceMonitor()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_mutex.unlock();
+
+    uint64_t one = 1;
+    if (write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+        qWarning("QPA-HWC: could not wake up fence monitor");
+    wait();
+
+    foreach (int fd, m_watches.keys())
+        removeWatch(fd);
+
+    close(m_wakeFd);
+    close(m_epollFd);
+}
+
+qint64 HwComposerFenceMonitor::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+bool HwComposerFenceMonitor::watch(int fenceFd, Listener *listener, int id)
+{
+    if (fenceFd < 0)
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+
+    // Tag the event with a serial, so an event for an fd number that was
+    // dropped and reused meanwhile isn't mistaken for the new fence
+    quint32 serial = ++m_serial;
+    if (serial == 0)
+        serial = ++m_serial;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = (quint64(serial) << 32) | quint32(fenceFd);
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fenceFd, &ev) == -1) {
+        qWarning("QPA-HWC: cannot poll fence %d: %s", fenceFd, strerror(errno));
+        return false;
+    }
+
+    Watch w;
+    w.listener = listener;
+    w.id = id;
+    w.serial = serial;
+    w.polled = false;
+    m_watches.insert(fenceFd, w);
+    return true;
+}
+
+void HwComposerFenceMonitor::watchOrPoll(int fenceFd, Listener *listener, int id)
+{
+    if (fenceFd < 0) {
+        listener->fenceSignaled(id, now());
+        return;
+    }
+
+    if (watch(fenceFd, listener, id))
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    Watch w;
+    w.listener = listener;
+    w.id = id;
+    w.serial = 0;
+    w.polled = true;
+    m_watches.insert(fenceFd, w);
+
+    // Have the monitor start checking on a timeout
+    if (m_polledCount++ == 0) {
+        uint64_t one = 1;
+        if (write(m_wakeFd, &one, sizeof(one)) != sizeof(one))
+            qWarning("QPA-HWC: could not wake up fence monitor");
+    }
+}
+
+void HwComposerFenceMonitor::removeWatch(int fd)
+{
+    // Called with m_mutex held
+    if (m_watches.value(fd).polled)
+        m_polledCount--;
+    else
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    m_watches.remove(fd);
+}
+
+void HwComposerFenceMonitor::removeListener(Listener *listener)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QList<int> fds;
+    for (QHash<int, Watch>::const_iterator it = m_watches.constBegin(); it != m_watches.constEnd(); ++it) {
+        if (it.value().listener == listener)
+            fds.append(it.key());
+    }
+
+    foreach (int fd, fds)
+        removeWatch(fd);
+
+    m_cond.wakeAll();
+}
+
+int HwComposerFenceMonitor::pendingCount(Listener *listener)
+{
+    QMutexLocker locker(&m_mutex);
+    return pendingCountLocked(listener);
+}
+
+int HwComposerFenceMonitor::pendingCountLocked(Listener *listener) const
+{
+    int count = 0;
+    for (QHash<int, Watch>::const_iterator it = m_watches.constBegin(); it != m_watches.constEnd(); ++it) {
+        if (it.value().listener == listener)
+            count++;
+    }
+    return count;
+}
+
+bool HwComposerFenceMonitor::waitForPending(Listener *listener, int maxPending, int timeoutMs)
+{
+    qint64 deadline = now() + qint64(timeoutMs) * 1000000LL;
+
+    QMutexLocker locker(&m_mutex);
+    while (pendingCountLocked(listener) > maxPending) {
+        if (timeoutMs < 0) {
+            m_cond.wait(&m_mutex);
+            continue;
+        }
+
+        qint64 remaining = (deadline - now()) / 1000000LL;
+        if (remaining <= 0)
+            return false;
+
+        m_cond.wait(&m_mutex, remaining);
+    }
+    return true;
+}
+
+qint64 HwComposerFenceMonitor::lastSignalTime()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_lastSignalTime;
+}
+
+void HwComposerFenceMonitor::run()
+{
+    struct epoll_event events[16];
+
+    for (;;) {
+        m_mutex.lock();
+        int timeout = m_polledCount ? 4 : -1;
+        m_mutex.unlock();
+
+        int n = epoll_wait(m_epollFd, events, 16, timeout);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            qWarning("QPA-HWC: fence monitor epoll_wait failed: %s", strerror(errno));
+            return;
+        }
+
+        qint64 timestamp = now();
+
+        QMutexLocker locker(&m_mutex);
+        if (m_quit)
+            return;
+
+        for (int i = 0; i < n; i++) {
+            int fd = int(events[i].data.u64 & 0xffffffff);
+            quint32 serial = quint32(events[i].data.u64 >> 32);
+
+            if (serial == 0 && fd == m_wakeFd) {
+                uint64_t value;
+                while (read(m_wakeFd, &value, sizeof(value)) > 0)
+                    ;
+                continue;
+            }
+
+            // The fence may have been dropped by removeListener() meanwhile
+            QHash<int, Watch>::const_iterator it = m_watches.constFind(fd);
+            if (it == m_watches.constEnd() || it.value().serial != serial)
+                continue;
+
+            Watch w = it.value();
+            removeWatch(fd);
+
+            m_lastSignalTime = timestamp;
+            w.listener->fenceSignaled(w.id, timestamp);
+        }
+
+        if (m_polledCount) {
+            QList<int> signaled;
+            for (QHash<int, Watch>::const_iterator it = m_watches.constBegin(); it != m_watches.constEnd(); ++it) {
+                if (it.value().polled && sync_wait(it.key(), 0) == 0)
+                    signaled.append(it.key());
+            }
+            foreach (int fd, signaled) {
+                Watch w = m_watches.value(fd);
+                removeWatch(fd);
+
+                m_lastSignalTime = timestamp;
+                w.listener->fenceSignaled(w.id, timestamp);
+            }
+        }
+
+        m_cond.wakeAll();
+    }
+}
@@ -0,0 +1,117 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_FENCEMONITOR_H
+#define HWCOMPOSER_FENCEMONITOR_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+
+// Watches sync fence fds from an epoll thread and tells the interested
+// party when they signal, so backends can throttle against fence
+// completion without blocking the render thread in sync_wait().
+class HwComposerFenceMonitor : public QThread
+{
+public:
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        // Called on the monitor thread with the CLOCK_MONOTONIC time (in ns)
+        // the fence was seen signaled. Must not call back into the monitor.
+        virtual void fenceSignaled(int id, qint64 timestamp) = 0;
+    };
+
+    static HwComposerFenceMonitor *instance();
+
+    // Takes ownership of fenceFd if it returns true. If the fence can't be
+    // polled, false is returned and the caller still owns the fd.
+    bool watch(int fenceFd, Listener *listener, int id = 0);
+
+    // Like watch(), but a fence that can't be polled is checked every few
+    // ms instead, so it always takes ownership of fenceFd. No fence (-1)
+    // counts as signaled, fenceSignaled() is called right away then.
+    void watchOrPoll(int fenceFd, Listener *listener, int id = 0);
+
+    // Drops (and closes) all fences still watched for listener
+    void removeListener(Listener *listener);
+
+    // Number of fences of listener that haven't signaled yet
+    int pendingCount(Listener *listener);
+
+    // Block until at most maxPending fences of listener are unsignaled,
+    // returns false on timeout. A negative timeout waits forever.
+    bool waitForPending(Listener *listener, int maxPending, int timeoutMs);
+
+    // CLOCK_MONOTONIC time (in ns) of the most recently signaled fence
+    qint64 lastSignalTime();
+
+    static qint64 now();
+
+    HwComposerFenceMonitor();
+    ~HwComposerFenceMonitor();
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    struct Watch {
+        Listener *listener;
+        int id;
+        quint32 serial;
+        bool polled;
+    };
+
+    void removeWatch(int fd);
+    int pendingCountLocked(Listener *listener) const;
+
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    QHash<int, Watch> m_watches;
+    int m_epollFd;
+    int m_wakeFd;
+    int m_polledCount;
+    quint32 m_serial;
+    qint64 m_lastSignalTime;
+    bool m_quit;
+};
+
+#endif /* HWCOMPOSER_FENCEMONITOR_H */
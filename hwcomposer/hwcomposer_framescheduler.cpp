@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_framescheduler.h"
+#include "hwcomposer_vsynctimeline.h"
+
+// Safety margin bounds, and how it moves on missed and made vsyncs
+static const qint64 HWC_PLUGIN_MIN_MARGIN = 1000000;
+static const qint64 HWC_PLUGIN_MARGIN_STEP_UP = 1000000;
+static const qint64 HWC_PLUGIN_MARGIN_STEP_DOWN = 250000;
+// Frames in a row that made their vsync before the margin shrinks
+static const int HWC_PLUGIN_HITS_TO_SHRINK = 60;
+// Decay of the cost estimate towards cheaper frames, as 1/n. Dearer
+// frames raise it right away, a frame too late costs more than one early.
+static const int HWC_PLUGIN_COST_DECAY = 16;
+
+HwComposerFrameScheduler::HwComposerFrameScheduler(HwComposerVsyncTimeline *timeline)
+    : m_timeline(timeline)
+    , m_fixedDelay(-1)
+    , m_plannedTarget(0)
+    , m_cost(0)
+    , m_margin(2 * HWC_PLUGIN_MIN_MARGIN)
+    , m_hits(0)
+    , m_deliveredAt(0)
+    , m_target(0)
+    , m_sampleCost(-1)
+    , m_sampleMissed(0)
+{
+    if (qEnvironmentVariableIsSet("QPA_HWC_IDLE_TIME"))
+        m_fixedDelay = qBound(5, qgetenv("QPA_HWC_IDLE_TIME").toInt(), 100);
+}
+
+void HwComposerFrameScheduler::takeSample()
+{
+    qint64 cost = m_sampleCost.fetchAndStoreAcquire(-1);
+    if (cost < 0)
+        return;
+
+    if (cost > m_cost)
+        m_cost = cost;
+    else
+        m_cost += (cost - m_cost) / HWC_PLUGIN_COST_DECAY;
+
+    qint64 period = m_timeline->period();
+    if (m_sampleMissed.fetchAndStoreAcquire(0)) {
+        m_margin = qMin(m_margin + HWC_PLUGIN_MARGIN_STEP_UP, qMax(period / 2, HWC_PLUGIN_MIN_MARGIN));
+        m_hits = 0;
+    } else if (++m_hits >= HWC_PLUGIN_HITS_TO_SHRINK) {
+        m_margin = qMax(m_margin - HWC_PLUGIN_MARGIN_STEP_DOWN, HWC_PLUGIN_MIN_MARGIN);
+        m_hits = 0;
+    }
+}
+
+int HwComposerFrameScheduler::deliveryDelay(qint64 vsyncTimestamp, qint64 now)
+{
+    if (m_fixedDelay >= 0) {
+        // Nothing to plan, but the frame still aims for the first vsync
+        // after the delay
+        qint64 period = m_timeline->period();
+        m_plannedTarget = 0;
+        if (period > 0)
+            m_plannedTarget = vsyncTimestamp + (m_fixedDelay * Q_INT64_C(1000000) / period + 1) * period;
+        return m_fixedDelay;
+    }
+
+    takeSample();
+
+    qint64 period = m_timeline->period();
+    if (period <= 0) {
+        m_plannedTarget = 0;
+        return 0;
+    }
+
+    if (!m_cost)
+        m_cost = period / 2;
+
+    // Earliest vsync we can still make when starting now, and the latest
+    // start that makes it
+    qint64 lead = m_cost + m_margin;
+    qint64 target = vsyncTimestamp + period;
+    if (target - lead < now)
+        target += ((now + lead - target) / period + 1) * period;
+    m_plannedTarget = target;
+
+    qint64 delay = target - lead - now;
+    return int(qMax(delay, Q_INT64_C(0)) / 1000000);
+}
+
+void HwComposerFrameScheduler::updateDelivered(qint64 now)
+{
+    if (!m_plannedTarget)
+        return;
+
+    // One delivery per plan, later ones (e.g. after a fence held the
+    // update back) would measure the wait rather than the frame
+    m_target.storeRelease(m_plannedTarget);
+    m_deliveredAt.storeRelease(now);
+    m_plannedTarget = 0;
+}
+
+bool HwComposerFrameScheduler::framePresented(qint64 now, qint64 *target)
+{
+    // Only frames rendered for an update we delivered say something
+    qint64 deliveredAt = m_deliveredAt.fetchAndStoreAcquire(0);
+    if (!deliveredAt || now < deliveredAt)
+        return false;
+
+    qint64 aimedFor = m_target.loadAcquire();
+    m_sampleMissed.storeRelease(now > aimedFor ? 1 : 0);
+    m_sampleCost.storeRelease(now - deliveredAt);
+    if (target)
+        *target = aimedFor;
+    return true;
+}
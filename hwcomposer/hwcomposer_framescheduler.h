@@ -0,0 +1,91 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_FRAMESCHEDULER_H
+#define HWCOMPOSER_FRAMESCHEDULER_H
+
+#include <QtGlobal>
+#include <QAtomicInteger>
+
+class HwComposerVsyncTimeline;
+
+// Decides when to deliver update requests after a vsync. Frames should
+// start as late as possible, so they sample the freshest input, yet reach
+// the hwc before the vsync they aim for. The time from delivering an
+// update to the frame being presented is measured, and delivery planned
+// for next vsync - predicted frame cost - margin. The margin grows when
+// frames miss their vsync, and slowly shrinks back while they don't.
+//
+// QPA_HWC_IDLE_TIME (ms) still gives a fixed delay after vsync instead.
+class HwComposerFrameScheduler
+{
+public:
+    explicit HwComposerFrameScheduler(HwComposerVsyncTimeline *timeline);
+
+    // GUI thread: ms from now to deliver the updates for the vsync at
+    // vsyncTimestamp. Times are CLOCK_MONOTONIC in ns.
+    int deliveryDelay(qint64 vsyncTimestamp, qint64 now);
+    // GUI thread, when the updates are actually delivered
+    void updateDelivered(qint64 now);
+
+    // Present thread, after the hwc took the frame. True if it was rendered
+    // for an update we delivered, *target is the vsync it was meant for.
+    bool framePresented(qint64 now, qint64 *target = NULL);
+
+private:
+    void takeSample();
+
+    HwComposerVsyncTimeline *m_timeline;
+    int m_fixedDelay;
+
+    // GUI thread only
+    qint64 m_plannedTarget;
+    qint64 m_cost;
+    qint64 m_margin;
+    int m_hits;
+
+    // Handed from the GUI thread to the present thread and back
+    QAtomicInteger<qint64> m_deliveredAt;
+    QAtomicInteger<qint64> m_target;
+    QAtomicInteger<qint64> m_sampleCost;
+    QAtomicInt m_sampleMissed;
+};
+
+#endif /* HWCOMPOSER_FRAMESCHEDULER_H */
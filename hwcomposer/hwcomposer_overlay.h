@@ -0,0 +1,120 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_OVERLAY_H
+#define HWCOMPOSER_OVERLAY_H
+
+#include <QtCore/QRect>
+#include <QtCore/QRectF>
+
+struct ANativeWindowBuffer;
+
+/**
+ * A compositor-provided buffer the hwc can show as an overlay layer,
+ * next to the GL content of the window.
+ *
+ * Overlays are set for the next swap of a window through the
+ * "setoverlaylayers" function of nativeResourceFunctionForIntegration():
+ *
+ *   void setOverlayLayers(QWindow *window, const HwcOverlayLayer *layers, int count)
+ *
+ * It has to be called from the thread swapping the window, before the
+ * swap. Each layer is reported back exactly once through presented(),
+ * from the thread that presents the frame. If the hwc turned the layer
+ * down (or the backend has no overlay support), composited is false and
+ * the buffer wasn't shown; the compositor should draw it with GL from
+ * then on. The frame is still shown without the turned down layer, and
+ * the window gets an update request to draw it in. The callee owns
+ * releaseFenceFd, it is -1 if unused.
+ **/
+struct HwcOverlayLayer
+{
+    ANativeWindowBuffer *buffer;
+    // Ownership passes to the plugin, -1 if the buffer is ready
+    int acquireFenceFd;
+
+    // Screen coordinates
+    QRect displayFrame;
+    // Buffer coordinates
+    QRectF sourceCrop;
+
+    // Stacking among overlays. Layers with a negative z go below the GL
+    // content, which then has to be transparent where they should show.
+    int z;
+    // No blending needed, e.g. video frames
+    bool opaque;
+
+    void (*presented)(void *userData, bool composited, int releaseFenceFd);
+    void *userData;
+};
+
+/**
+ * A full-screen client buffer, scanned out in place of the GL content of
+ * the window (direct rendering, e.g. for full-screen games and video).
+ *
+ * Buffers are offered through the "displaybuffer" function of
+ * nativeResourceFunctionForIntegration():
+ *
+ *   bool displayBuffer(QScreen *screen, const HwcScanoutBuffer *buffer)
+ *
+ * Direct rendering has to be switched on first with the
+ * "setdirectrenderingactive" function:
+ *
+ *   void setDirectRenderingActive(QScreen *screen, bool active)
+ *
+ * displayBuffer() returns false if the buffer can't be scanned out, e.g.
+ * because it doesn't cover the screen; nothing was taken over then and the
+ * compositor has to draw the buffer itself. Otherwise displayed() is called
+ * once the buffer was handed to the display, and release() once the
+ * display is done reading it, which is after another frame replaced it.
+ * Both are called on the thread of the screen.
+ **/
+struct HwcScanoutBuffer
+{
+    ANativeWindowBuffer *buffer;
+    // Ownership passes to the plugin if accepted, -1 if the buffer is ready
+    int acquireFenceFd;
+
+    void (*displayed)(void *userData);
+    void (*release)(void *userData);
+    void *userData;
+};
+
+#endif /* HWCOMPOSER_OVERLAY_H */
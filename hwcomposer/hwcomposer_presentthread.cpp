@@ -0,0 +1,121 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_presentthread.h"
+
+#include "qsystrace_selector.h"
+
+#ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
+
+HwComposerPresentThread::HwComposerPresentThread(Client *client, int maxPending)
+    : m_client(client)
+    , m_maxPending(qMax(1, maxPending))
+    , m_pending(0)
+    , m_quit(false)
+{
+    setObjectName(QStringLiteral("QPA-HWC-present"));
+    start(QThread::TimeCriticalPriority);
+}
+
+HwComposerPresentThread::~HwComposerPresentThread()
+{
+    // Present whatever is still queued so no buffer is left without a fence
+    waitForPending(0);
+
+    m_mutex.lock();
+    m_quit = true;
+    m_cond.wakeAll();
+    m_mutex.unlock();
+
+    wait();
+}
+
+bool HwComposerPresentThread::isEnabled()
+{
+    return qgetenv("QPA_HWC_PRESENT_THREAD").toInt() > 0;
+}
+
+void HwComposerPresentThread::queueBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame)
+{
+    QueuedFrame queued;
+    queued.buffer = buffer;
+    queued.frame = frame;
+
+    QMutexLocker locker(&m_mutex);
+    while (m_pending >= m_maxPending)
+        m_cond.wait(&m_mutex);
+
+    m_queue.enqueue(queued);
+    m_pending++;
+    m_cond.wakeAll();
+}
+
+void HwComposerPresentThread::waitForPending(int maxPending)
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_pending > maxPending)
+        m_cond.wait(&m_mutex);
+}
+
+void HwComposerPresentThread::run()
+{
+    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        while (m_queue.isEmpty() && !m_quit)
+            m_cond.wait(&m_mutex);
+
+        if (m_queue.isEmpty())
+            break;
+
+        QueuedFrame queued = m_queue.dequeue();
+
+        locker.unlock();
+        {
+            QSystraceEvent trace("graphics", "QPA::presentThread");
+            m_client->presentBuffer(queued.buffer, queued.frame);
+        }
+        locker.relock();
+
+        m_pending--;
+        m_cond.wakeAll();
+    }
+}
+
+#endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
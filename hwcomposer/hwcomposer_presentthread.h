@@ -0,0 +1,112 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_PRESENTTHREAD_H
+#define HWCOMPOSER_PRESENTTHREAD_H
+
+#ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
+
+// libhybris access to the native hwcomposer window
+#include <hwcomposer_window.h>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QRegion>
+#include <QVector>
+
+#include "hwcomposer_overlay.h"
+
+// Per-swap state that goes along with the buffer
+struct HwComposerFrame
+{
+    QRegion damage;
+    QVector<HwcOverlayLayer> overlays;
+};
+
+// Worker thread that takes the hwcomposer calls (prepare/set or
+// validate/present) off the render thread. The render thread hands over
+// the queued buffer in present() and returns to rendering the next frame,
+// the worker presents the buffer and hands back the release fence.
+class HwComposerPresentThread : public QThread
+{
+public:
+    class Client {
+    public:
+        virtual ~Client() {}
+        // Called on the worker thread, must set the release fence of buffer
+        virtual void presentBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame) = 0;
+    };
+
+    HwComposerPresentThread(Client *client, int maxPending);
+    ~HwComposerPresentThread();
+
+    // Opt-in via QPA_HWC_PRESENT_THREAD=1
+    static bool isEnabled();
+
+    // Hand over a buffer, blocks only if the queue is full
+    void queueBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame);
+
+    // Block until at most maxPending buffers are still waiting to be presented
+    void waitForPending(int maxPending);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    struct QueuedFrame {
+        HWComposerNativeWindowBuffer *buffer;
+        HwComposerFrame frame;
+    };
+
+    Client *m_client;
+    int m_maxPending;
+    QMutex m_mutex;
+    QWaitCondition m_cond;
+    QQueue<QueuedFrame> m_queue;
+    // Buffers queued or currently being presented by the worker
+    int m_pending;
+    bool m_quit;
+};
+
+#endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
+
+#endif /* HWCOMPOSER_PRESENTTHREAD_H */
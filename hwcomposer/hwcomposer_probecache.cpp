@@ -0,0 +1,211 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_probecache.h"
+#include "hwcomposer_backend.h"
+
+#include <QtCore/qglobal.h>
+#include <private/qcore_unix_p.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const quint32 HWC_PLUGIN_PROBE_CACHE_MAGIC = 0x51484331; /* "QHC1" */
+static const quint32 HWC_PLUGIN_PROBE_CACHE_VERSION = 1;
+
+struct HwComposerProbeCache::Data {
+    quint32 magic;
+    quint32 version;
+    char fingerprint[128];
+    Entry entry;
+    quint32 checksum;
+};
+
+Q_GLOBAL_STATIC(HwComposerProbeCache, probeCache)
+
+HwComposerProbeCache *HwComposerProbeCache::instance()
+{
+    return probeCache();
+}
+
+QByteArray HwComposerProbeCache::buildFingerprint()
+{
+    // A system update replaces these, and with them possibly the hwc
+    static const char *const buildFiles[] = {
+        "/system/build.prop",
+        "/vendor/build.prop",
+        "/system/vendor/build.prop",
+    };
+
+    QByteArray fingerprint;
+    for (size_t i = 0; i < sizeof(buildFiles) / sizeof(buildFiles[0]); i++) {
+        struct stat st;
+        if (stat(buildFiles[i], &st) == 0) {
+            fingerprint += QByteArray::number(qint64(st.st_ino)) + ':' +
+                           QByteArray::number(qint64(st.st_size)) + ':' +
+                           QByteArray::number(qint64(st.st_mtime)) + ';';
+        }
+    }
+    return fingerprint;
+}
+
+HwComposerProbeCache::HwComposerProbeCache()
+    : m_data(NULL)
+    , m_verifyRequested(false)
+{
+    if (qgetenv("QPA_HWC_WORKAROUNDS").split(',').contains("no-probe-cache"))
+        return;
+
+    QByteArray runtimeDir = qgetenv("XDG_RUNTIME_DIR");
+    if (runtimeDir.isEmpty())
+        return;
+
+    m_fingerprint = buildFingerprint();
+    // Nothing tells this build apart from the next one
+    if (m_fingerprint.isEmpty())
+        return;
+    m_fingerprint.truncate(sizeof(((Data *)0)->fingerprint) - 1);
+
+    QByteArray path = runtimeDir + "/qpa-hwc-probe.cache";
+    int fd = qt_safe_open(path.constData(), O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        qWarning("QPA-HWC: cannot open probe cache %s: %s", path.constData(), strerror(errno));
+        return;
+    }
+
+    if (ftruncate(fd, sizeof(Data)) == 0) {
+        void *data = mmap(NULL, sizeof(Data), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED)
+            m_data = static_cast<Data *>(data);
+    }
+    if (!m_data)
+        qWarning("QPA-HWC: cannot map probe cache %s: %s", path.constData(), strerror(errno));
+    qt_safe_close(fd);
+}
+
+HwComposerProbeCache::~HwComposerProbeCache()
+{
+    if (m_data)
+        munmap(m_data, sizeof(Data));
+}
+
+quint32 HwComposerProbeCache::checksum(const Data *data)
+{
+    // Catches entries torn by two compositors starting at once
+    return qChecksum(reinterpret_cast<const char *>(data), offsetof(Data, checksum));
+}
+
+bool HwComposerProbeCache::lookup(Entry *entry) const
+{
+    if (!m_data)
+        return false;
+
+    Data data;
+    memcpy(&data, m_data, sizeof(Data));
+    if (data.magic != HWC_PLUGIN_PROBE_CACHE_MAGIC ||
+        data.version != HWC_PLUGIN_PROBE_CACHE_VERSION ||
+        data.checksum != checksum(&data) ||
+        strncmp(data.fingerprint, m_fingerprint.constData(), sizeof(data.fingerprint)) != 0)
+        return false;
+
+    *entry = data.entry;
+    return true;
+}
+
+void HwComposerProbeCache::store(const Entry &entry)
+{
+    if (!m_data)
+        return;
+
+    Data data;
+    memset(&data, 0, sizeof(Data));
+    data.magic = HWC_PLUGIN_PROBE_CACHE_MAGIC;
+    data.version = HWC_PLUGIN_PROBE_CACHE_VERSION;
+    strncpy(data.fingerprint, m_fingerprint.constData(), sizeof(data.fingerprint) - 1);
+    data.entry = entry;
+    data.entry.moduleId[sizeof(data.entry.moduleId) - 1] = '\0';
+    data.checksum = checksum(&data);
+
+    memcpy(m_data, &data, sizeof(Data));
+    msync(m_data, sizeof(Data), MS_ASYNC);
+}
+
+void HwComposerProbeCache::requestVerify()
+{
+    m_verifyRequested = true;
+}
+
+void HwComposerProbeCache::verify(HwComposerBackend *backend)
+{
+    if (!m_verifyRequested)
+        return;
+    m_verifyRequested = false;
+
+    Entry entry;
+    if (!lookup(&entry))
+        return;
+
+    int width = 0, height = 0;
+    float physicalWidth = 0, physicalHeight = 0;
+    if (!backend->getScreenSizes(&width, &height, &physicalWidth, &physicalHeight))
+        return;
+    float refreshRate = backend->refreshRate();
+
+    if (width == entry.width && height == entry.height &&
+        qFuzzyCompare(physicalWidth, entry.physicalWidth) &&
+        qFuzzyCompare(physicalHeight, entry.physicalHeight) &&
+        qFuzzyCompare(refreshRate, entry.refreshRate))
+        return;
+
+    qWarning("QPA-HWC: display changed since it was cached (%dx%d@%.2f, now %dx%d@%.2f), "
+             "using the new values from the next start",
+             entry.width, entry.height, entry.refreshRate, width, height, refreshRate);
+    entry.width = width;
+    entry.height = height;
+    entry.physicalWidth = physicalWidth;
+    entry.physicalHeight = physicalHeight;
+    entry.refreshRate = refreshRate;
+    store(entry);
+}
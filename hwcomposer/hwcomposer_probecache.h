@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_PROBECACHE_H
+#define HWCOMPOSER_PROBECACHE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+class HwComposerBackend;
+
+// What start-up found out about the hwc and the display, kept in a small
+// memory-mapped file in $XDG_RUNTIME_DIR so the next start of the
+// compositor can pick the backend and lay out the screen without asking
+// the hwc first. Entries are tied to the Android build (by the identity
+// of its build.prop files), and checked against the hwc after the first
+// frame.
+// QPA_HWC_WORKAROUNDS=no-probe-cache turns it off.
+class HwComposerProbeCache
+{
+public:
+    enum Backend {
+        BackendUnknown = 0,
+        Backend_v0,
+        Backend_v10,
+        Backend_v11,
+        Backend_v20
+    };
+
+    struct Entry {
+        qint32 backend;
+        char moduleId[32];
+        quint32 deviceVersion;
+        qint32 width;
+        qint32 height;
+        float physicalWidth;
+        float physicalHeight;
+        float refreshRate;
+    };
+
+    static HwComposerProbeCache *instance();
+
+    // Identity of the Android build, empty if it can't be told apart
+    static QByteArray buildFingerprint();
+
+    // The entry for this build, false if there is none
+    bool lookup(Entry *entry) const;
+    void store(const Entry &entry);
+
+    // Cached display values are in use, have verify() check them
+    void requestVerify();
+    // Compare the cached display values with what the backend reports and
+    // fix the entry for the next start. Called on the GUI thread once the
+    // first frame is out, the backend isn't safe to query from elsewhere.
+    void verify(HwComposerBackend *backend);
+
+    HwComposerProbeCache();
+    ~HwComposerProbeCache();
+
+private:
+    struct Data;
+    static quint32 checksum(const Data *data);
+
+    Data *m_data;
+    QByteArray m_fingerprint;
+    bool m_verifyRequested;
+};
+
+#endif /* HWCOMPOSER_PROBECACHE_H */
@@ -41,6 +41,7 @@
 
 #include "hwcomposer_screeninfo.h"
 #include "hwcomposer_backend.h"
+#include "hwcomposer_probecache.h"
 
 #include <private/qmath_p.h>
 #include <private/qcore_unix_p.h>
@@ -209,8 +210,30 @@ private:
 class HwComposerScreenInfoHWCSource {
 public:
     HwComposerScreenInfoHWCSource(HwComposerBackend *backend) {
-        m_have_values = backend->getScreenSizes(&m_width, &m_height, &m_physicalWidth, &m_physicalHeight);
         m_depth = 32;
+
+        // Values from the last start are checked against the hwc later
+        HwComposerProbeCache *cache = HwComposerProbeCache::instance();
+        HwComposerProbeCache::Entry entry;
+        if (cache->lookup(&entry) && entry.width > 0 && entry.height > 0) {
+            m_width = entry.width;
+            m_height = entry.height;
+            m_physicalWidth = entry.physicalWidth;
+            m_physicalHeight = entry.physicalHeight;
+            m_have_values = true;
+            cache->requestVerify();
+            return;
+        }
+
+        m_have_values = backend->getScreenSizes(&m_width, &m_height, &m_physicalWidth, &m_physicalHeight);
+        if (m_have_values && cache->lookup(&entry)) {
+            entry.width = m_width;
+            entry.height = m_height;
+            entry.physicalWidth = m_physicalWidth;
+            entry.physicalHeight = m_physicalHeight;
+            entry.refreshRate = backend->refreshRate();
+            cache->store(entry);
+        }
     }
 
     QSizeF physicalScreenSize()
@@ -253,20 +276,27 @@ HwComposerScreenInfo::HwComposerScreenInfo(HwComposerBackend *backend)
      * Look up the values in the following order of preference:
      *
      *  1. Environment variables can override everything
-     *  2. fbdev via FBIOGET_VSCREENINFO is preferred otherwise
-     *  3. Fallback values (with warnings) if 1. and 2. fail
+     *  2. The hwc display attributes are preferred otherwise
+     *  3. fbdev via FBIOGET_VSCREENINFO, opened only if 2. fails
+     *  4. Fallback values (with warnings) if all of the above fail
      **/
-    HwComposerScreenInfoHWCSource hwcSource(backend);
     HwComposerScreenInfoEnvironmentSource envSource;
-    HwComposerScreenInfoFbDevSource fbdevSource;
+    HwComposerScreenInfoHWCSource hwcSource(backend);
+    // Opening the fbdev is only worth it when the hwc can't tell
+    QScopedPointer<HwComposerScreenInfoFbDevSource> fbdevSource;
+    if (!hwcSource.isValid() && !(envSource.hasScreenSize() &&
+                                  envSource.hasPhysicalScreenSize() &&
+                                  envSource.hasScreenDepth()))
+        fbdevSource.reset(new HwComposerScreenInfoFbDevSource);
+    bool fbdevValid = fbdevSource && fbdevSource->isValid();
     HwComposerScreenInfoFallbackSource fallbackSource;
 
     if (envSource.hasScreenSize()) {
         m_screenSize = envSource.screenSize();
     } else if (hwcSource.isValid()) {
         m_screenSize = hwcSource.screenSize();
-    } else if (fbdevSource.isValid()) {
-        m_screenSize = fbdevSource.screenSize();
+    } else if (fbdevValid) {
+        m_screenSize = fbdevSource->screenSize();
     } else {
         m_screenSize = fallbackSource.screenSize();
     }
@@ -275,8 +305,8 @@ HwComposerScreenInfo::HwComposerScreenInfo(HwComposerBackend *backend)
         m_physicalScreenSize = envSource.physicalScreenSize();
     } else if (hwcSource.isValid()) {
         m_physicalScreenSize = hwcSource.physicalScreenSize();
-    } else if (fbdevSource.isValid()) {
-        m_physicalScreenSize = fbdevSource.physicalScreenSize();
+    } else if (fbdevValid) {
+        m_physicalScreenSize = fbdevSource->physicalScreenSize();
     } else {
         m_physicalScreenSize = fallbackSource.physicalScreenSize(m_screenSize);
     }
@@ -285,8 +315,8 @@ HwComposerScreenInfo::HwComposerScreenInfo(HwComposerBackend *backend)
         m_screenDepth = envSource.screenDepth();
     } else if (hwcSource.isValid()) {
         m_screenDepth = hwcSource.screenDepth();
-    } else if (fbdevSource.isValid()) {
-        m_screenDepth = fbdevSource.screenDepth();
+    } else if (fbdevValid) {
+        m_screenDepth = fbdevSource->screenDepth();
     } else {
         m_screenDepth = fallbackSource.screenDepth();
     }
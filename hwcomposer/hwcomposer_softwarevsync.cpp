@@ -0,0 +1,151 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_softwarevsync.h"
+#include "hwcomposer_vsynctimeline.h"
+#include "hwcomposer_fencemonitor.h"
+
+#include <QtCore/QEvent>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+// A fence further than this from a predicted vsync counts as drift, 2 ms.
+// Fences are seen a bit late, so this can't be much tighter.
+static const qint64 HWC_PLUGIN_MAX_PHASE_ERROR = 2000000;
+// Fences in a row that have to be off before resyncing
+static const int HWC_PLUGIN_DRIFT_FENCES = 3;
+
+HwComposerSoftwareVsync::HwComposerSoftwareVsync(HwComposerVsyncTimeline *timeline,
+                                                 HwComposerVsyncNotifier::Listener *listener,
+                                                 QObject *parent)
+    : QSocketNotifier(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC), QSocketNotifier::Read, parent)
+    , m_timeline(timeline)
+    , m_listener(listener)
+    , m_tickTime(0)
+    , m_armed(false)
+    , m_driftCount(0)
+{
+    if (socket() < 0)
+        qWarning("Failed to create vsync timerfd: %s, using hardware vsync only", strerror(errno));
+}
+
+HwComposerSoftwareVsync::~HwComposerSoftwareVsync()
+{
+    setEnabled(false);
+    if (socket() >= 0)
+        close(socket());
+}
+
+bool HwComposerSoftwareVsync::isEnabled()
+{
+    return qgetenv("QPA_HWC_SOFTWARE_VSYNC").toInt() > 0;
+}
+
+bool HwComposerSoftwareVsync::requestTick()
+{
+    if (m_armed)
+        return true;
+
+    qint64 now = HwComposerFenceMonitor::now();
+    if (socket() < 0 || !m_timeline->isLocked(now))
+        return false;
+
+    m_tickTime = m_timeline->nextVsync(now);
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = m_tickTime / 1000000000;
+    spec.it_value.tv_nsec = m_tickTime % 1000000000;
+    if (timerfd_settime(socket(), TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        qWarning("Failed to arm vsync timerfd: %s", strerror(errno));
+        return false;
+    }
+
+    m_armed = true;
+    return true;
+}
+
+void HwComposerSoftwareVsync::cancel()
+{
+    if (!m_armed)
+        return;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(socket(), 0, &spec, NULL);
+    m_armed = false;
+}
+
+void HwComposerSoftwareVsync::presentFenceSignaled(qint64 timestamp)
+{
+    if (qAbs(m_timeline->phaseError(timestamp)) <= HWC_PLUGIN_MAX_PHASE_ERROR) {
+        m_driftCount = 0;
+        return;
+    }
+
+    if (++m_driftCount >= HWC_PLUGIN_DRIFT_FENCES) {
+        m_driftCount = 0;
+        m_timeline->requestResync();
+    }
+}
+
+bool HwComposerSoftwareVsync::event(QEvent *e)
+{
+    if (e->type() != QEvent::SockAct)
+        return QSocketNotifier::event(e);
+
+    uint64_t expirations;
+    ssize_t ret;
+    do {
+        ret = read(socket(), &expirations, sizeof(expirations));
+    } while (ret < 0 && errno == EINTR);
+
+    // Spurious wakeup, or cancelled after the timer fired
+    if (ret < 0 || !m_armed)
+        return true;
+
+    m_armed = false;
+    m_listener->vsyncReceived(m_tickTime);
+    return true;
+}
@@ -0,0 +1,86 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_SOFTWAREVSYNC_H
+#define HWCOMPOSER_SOFTWAREVSYNC_H
+
+#include <QSocketNotifier>
+
+#include "hwcomposer_vsyncnotifier.h"
+
+class HwComposerVsyncTimeline;
+
+// Update ticks from a timerfd, lined up with the vsync timeline, so the
+// hardware vsync interrupt can stay off while the model holds. Present
+// fences that signal off the predicted vsyncs make the model ask for a
+// new burst of hardware vsync samples.
+class HwComposerSoftwareVsync : public QSocketNotifier
+{
+public:
+    HwComposerSoftwareVsync(HwComposerVsyncTimeline *timeline,
+                            HwComposerVsyncNotifier::Listener *listener,
+                            QObject *parent = 0);
+    ~HwComposerSoftwareVsync();
+
+    // Opt-in via QPA_HWC_SOFTWARE_VSYNC=1
+    static bool isEnabled();
+
+    // Tick once at the next predicted vsync. Returns false if the model
+    // isn't locked, hardware vsync has to be used then.
+    bool requestTick();
+    void cancel();
+
+    // From the fence monitor thread, with the time a present (or
+    // retire) fence signaled
+    void presentFenceSignaled(qint64 timestamp);
+
+protected:
+    bool event(QEvent *e) Q_DECL_OVERRIDE;
+
+private:
+    HwComposerVsyncTimeline *m_timeline;
+    HwComposerVsyncNotifier::Listener *m_listener;
+    qint64 m_tickTime;
+    bool m_armed;
+    // Consecutive fences off the model, fence monitor thread only
+    int m_driftCount;
+};
+
+#endif /* HWCOMPOSER_SOFTWAREVSYNC_H */
@@ -0,0 +1,155 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_startuptimeline.h"
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QFile>
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *const phaseNames[HwComposerStartupTimeline::PhaseCount] = {
+    "HwComposerBackend::create",
+    "hwc module open",
+    "hotplug wait",
+    "eglInitialize",
+    "HwComposerScreenInfo",
+    "first createNativeWindow",
+    "first eglCreateWindowSurface",
+    "first present",
+    "first present fence",
+};
+
+// 0 is not recorded yet, zero initialized before any code runs
+static QAtomicInteger<qint64> phaseBegin[HwComposerStartupTimeline::PhaseCount];
+static QAtomicInteger<qint64> phaseEnd[HwComposerStartupTimeline::PhaseCount];
+static QAtomicInt dumped;
+
+static qint64 monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void record(QAtomicInteger<qint64> *slot, qint64 timestamp)
+{
+    if (slot->loadAcquire())
+        return;
+    slot->testAndSetOrdered(0, timestamp ? timestamp : monotonicNow());
+}
+
+void HwComposerStartupTimeline::begin(Phase phase, qint64 timestamp)
+{
+    record(&phaseBegin[phase], timestamp);
+}
+
+void HwComposerStartupTimeline::end(Phase phase, qint64 timestamp)
+{
+    record(&phaseEnd[phase], timestamp);
+}
+
+void HwComposerStartupTimeline::mark(Phase phase, qint64 timestamp)
+{
+    if (phaseEnd[phase].loadAcquire())
+        return;
+    if (!timestamp)
+        timestamp = monotonicNow();
+    record(&phaseBegin[phase], timestamp);
+    record(&phaseEnd[phase], timestamp);
+
+    // Nothing of interest happens after the first frame is on screen
+    if (phase == FirstPresentFence)
+        dump();
+}
+
+QByteArray HwComposerStartupTimeline::toJson()
+{
+    QByteArray pid = QByteArray::number(getpid());
+
+    // Complete events ("X") for phases with both ends, instant events ("i")
+    // for marks; timestamps in us as the format wants
+    QByteArray json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (int i = 0; i < PhaseCount; i++) {
+        qint64 begin = phaseBegin[i].loadAcquire();
+        qint64 end = phaseEnd[i].loadAcquire();
+        if (!begin)
+            continue;
+
+        if (!first)
+            json += ',';
+        first = false;
+
+        json += "\n{\"name\":\"";
+        json += phaseNames[i];
+        json += "\",\"cat\":\"qpa-hwc\",\"pid\":" + pid + ",\"tid\":" + pid;
+        json += ",\"ts\":" + QByteArray::number(double(begin) / 1000, 'f', 3);
+        if (end == begin) {
+            json += ",\"ph\":\"i\",\"s\":\"p\"}";
+        } else if (end > begin) {
+            json += ",\"ph\":\"X\",\"dur\":" + QByteArray::number(double(end - begin) / 1000, 'f', 3) + '}';
+        } else {
+            // Still running
+            json += ",\"ph\":\"B\"}";
+        }
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+void HwComposerStartupTimeline::dump()
+{
+    static const QByteArray target = qgetenv("QPA_HWC_STARTUP_TIMELINE");
+    if (target.isEmpty() || !dumped.testAndSetOrdered(0, 1))
+        return;
+
+    QByteArray json = toJson();
+    if (target == "-") {
+        fputs(json.constData(), stderr);
+        return;
+    }
+
+    QFile file(QString::fromLocal8Bit(target));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size())
+        qWarning("QPA-HWC: could not write the start-up timeline to %s", target.constData());
+}
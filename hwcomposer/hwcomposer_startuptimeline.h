@@ -0,0 +1,95 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_STARTUPTIMELINE_H
+#define HWCOMPOSER_STARTUPTIMELINE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+// Where the time goes between loading the plugin and the first frame on
+// screen. Each phase keeps the first time it began and ended in an atomic
+// slot, so recording takes no lock, and once a phase is recorded, further
+// calls (e.g. for every present) only load the slot.
+//
+// QPA_HWC_STARTUP_TIMELINE=<file> writes the phases in Trace Event Format
+// (chrome://tracing, Perfetto) once the first present fence has signaled,
+// or when the hwc context is destroyed before that.
+// "-" writes to stderr. The "startuptimeline" native resource function
+// returns the same JSON at any time.
+class HwComposerStartupTimeline
+{
+public:
+    enum Phase {
+        BackendCreate,
+        ModuleOpen,
+        HotplugWait,
+        EglInitialize,
+        ScreenInfo,
+        FirstNativeWindow,
+        FirstWindowSurface,
+        FirstPresent,
+        FirstPresentFence,
+        PhaseCount
+    };
+
+    // Times are CLOCK_MONOTONIC in ns, 0 takes the current time
+    static void begin(Phase phase, qint64 timestamp = 0);
+    static void end(Phase phase, qint64 timestamp = 0);
+    // A phase without a duration
+    static void mark(Phase phase, qint64 timestamp = 0);
+
+    static QByteArray toJson();
+    // Write the timeline if QPA_HWC_STARTUP_TIMELINE asks for it, only once
+    static void dump();
+
+    // Records the phase for the lifetime of the scope
+    class Scope
+    {
+    public:
+        explicit Scope(Phase phase) : m_phase(phase) { begin(phase); }
+        ~Scope() { end(m_phase); }
+
+    private:
+        Phase m_phase;
+    };
+};
+
+#endif /* HWCOMPOSER_STARTUPTIMELINE_H */
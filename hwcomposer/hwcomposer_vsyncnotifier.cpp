@@ -0,0 +1,106 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_vsyncnotifier.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEvent>
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+HwComposerVsyncNotifier::HwComposerVsyncNotifier(Listener *listener, QObject *parent)
+    : QSocketNotifier(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), QSocketNotifier::Read, parent)
+    , m_listener(listener)
+    , m_pending(0)
+    , m_timestamp(0)
+{
+    if (socket() < 0)
+        qWarning("Failed to create vsync eventfd: %s, falling back to posted events", strerror(errno));
+}
+
+HwComposerVsyncNotifier::~HwComposerVsyncNotifier()
+{
+    setEnabled(false);
+    if (socket() >= 0)
+        close(socket());
+}
+
+void HwComposerVsyncNotifier::notify(qint64 timestamp)
+{
+    m_timestamp.storeRelease(timestamp);
+
+    // One wakeup covers all vsyncs until the receiver got to it
+    if (!m_pending.testAndSetOrdered(0, 1))
+        return;
+
+    if (socket() >= 0) {
+        uint64_t one = 1;
+        ssize_t ret;
+        do {
+            ret = write(socket(), &one, sizeof(one));
+        } while (ret < 0 && errno == EINTR);
+    } else {
+        QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+    }
+}
+
+bool HwComposerVsyncNotifier::event(QEvent *e)
+{
+    if (e->type() != QEvent::SockAct && e->type() != QEvent::User)
+        return QSocketNotifier::event(e);
+
+    if (socket() >= 0) {
+        uint64_t count;
+        ssize_t ret;
+        do {
+            ret = read(socket(), &count, sizeof(count));
+        } while (ret < 0 && errno == EINTR);
+    }
+
+    // Clear before taking the timestamp, a vsync coming in meanwhile
+    // then raises a new wakeup instead of getting lost
+    m_pending.storeRelease(0);
+    m_listener->vsyncReceived(m_timestamp.loadAcquire());
+    return true;
+}
@@ -0,0 +1,78 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_VSYNCNOTIFIER_H
+#define HWCOMPOSER_VSYNCNOTIFIER_H
+
+#include <QSocketNotifier>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+// Hands vsync events from the hwc callback thread over to the thread the
+// notifier lives in. The callback thread only stores the timestamp in an
+// atomic slot and writes an eventfd if no wakeup is pending yet, so it
+// never allocates or blocks, and a burst of vsyncs while the receiving
+// thread is busy turns into a single wakeup with the latest timestamp.
+class HwComposerVsyncNotifier : public QSocketNotifier
+{
+public:
+    class Listener {
+    public:
+        virtual ~Listener() {}
+        // Called on the thread of the notifier
+        virtual void vsyncReceived(qint64 timestamp) = 0;
+    };
+
+    HwComposerVsyncNotifier(Listener *listener, QObject *parent = 0);
+    ~HwComposerVsyncNotifier();
+
+    // Safe to call from any thread
+    void notify(qint64 timestamp);
+
+protected:
+    bool event(QEvent *e) Q_DECL_OVERRIDE;
+
+private:
+    Listener *m_listener;
+    QAtomicInt m_pending;
+    QAtomicInteger<qint64> m_timestamp;
+};
+
+#endif /* HWCOMPOSER_VSYNCNOTIFIER_H */
@@ -0,0 +1,205 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_vsynctimeline.h"
+
+// Weight of a new period sample in the filtered period, as 1/n
+static const int HWC_PLUGIN_PERIOD_FILTER = 8;
+// Samples after a resync before the model is trusted on its own
+static const int HWC_PLUGIN_LOCK_SAMPLES = 6;
+// Longest time the model may run without a hardware vsync, 10 s
+static const qint64 HWC_PLUGIN_MAX_EXTRAPOLATION = Q_INT64_C(10000000000);
+// Reads racing with updates before settling for a mixed snapshot
+static const int HWC_PLUGIN_READ_RETRIES = 64;
+
+HwComposerVsyncTimeline::HwComposerVsyncTimeline()
+    : m_sequence(0)
+    , m_requestedPeriod(0)
+    , m_resyncRequested(0)
+    , m_lastVsync(0)
+    , m_period(0)
+    , m_nominalPeriod(0)
+    , m_samples(0)
+{
+}
+
+bool HwComposerVsyncTimeline::tryBeginWrite()
+{
+    // An odd sequence marks an update in progress. Vsync callbacks may come
+    // in on different binder threads, but a period apart, so one finding
+    // another still updating just drops its sample instead of spinning.
+    int sequence = m_sequence.loadAcquire();
+    return !(sequence & 1) && m_sequence.testAndSetAcquire(sequence, sequence + 1);
+}
+
+void HwComposerVsyncTimeline::endWrite()
+{
+    m_sequence.fetchAndAddRelease(1);
+}
+
+HwComposerVsyncTimeline::Snapshot HwComposerVsyncTimeline::read() const
+{
+    Snapshot snapshot;
+    qint64 requestedPeriod;
+    bool resyncRequested;
+    for (int retries = 0; ; retries++) {
+        // Before the snapshot, a request taken by the writer meanwhile is
+        // then in the snapshot already
+        requestedPeriod = m_requestedPeriod.loadAcquire();
+        resyncRequested = m_resyncRequested.loadAcquire();
+
+        int sequence = m_sequence.loadAcquire();
+        snapshot.lastVsync = m_lastVsync.loadAcquire();
+        snapshot.period = m_period.loadAcquire();
+        snapshot.nominalPeriod = m_nominalPeriod.loadAcquire();
+        snapshot.samples = m_samples.loadAcquire();
+
+        // A writer preempted mid-update holds nobody up for long: after a
+        // while the fields of two consecutive vsyncs are close enough
+        if ((!(sequence & 1) && m_sequence.loadAcquire() == sequence) ||
+            retries >= HWC_PLUGIN_READ_RETRIES)
+            break;
+    }
+
+    // What the writer applies with the next vsync
+    if (requestedPeriod > 0) {
+        snapshot.period = requestedPeriod;
+        snapshot.nominalPeriod = requestedPeriod;
+        snapshot.samples = 0;
+    }
+    if (resyncRequested)
+        snapshot.samples = 0;
+    return snapshot;
+}
+
+void HwComposerVsyncTimeline::setNominalPeriod(qint64 periodNs)
+{
+    m_requestedPeriod.storeRelease(periodNs);
+}
+
+void HwComposerVsyncTimeline::addVsync(qint64 timestamp)
+{
+    if (!tryBeginWrite())
+        return;
+
+    qint64 requestedPeriod = m_requestedPeriod.fetchAndStoreAcquire(0);
+    if (requestedPeriod > 0) {
+        m_nominalPeriod.storeRelease(requestedPeriod);
+        m_period.storeRelease(requestedPeriod);
+        m_samples.storeRelease(0);
+    }
+    if (m_resyncRequested.fetchAndStoreAcquire(0))
+        m_samples.storeRelease(0);
+
+    qint64 lastVsync = m_lastVsync.loadAcquire();
+    qint64 period = m_period.loadAcquire();
+    qint64 nominalPeriod = m_nominalPeriod.loadAcquire();
+
+    qint64 delta = timestamp - lastVsync;
+    if (lastVsync && period > 0 && delta > 0) {
+        // Vsync events are off while idle, so a gap spans several periods.
+        // Long gaps only move the phase, the period drifts too much.
+        qint64 periods = (delta + period / 2) / period;
+        if (periods >= 1 && periods <= 4) {
+            qint64 sample = delta / periods;
+            // Reject samples far off the nominal rate, e.g. a late event
+            if (!nominalPeriod || qAbs(sample - nominalPeriod) < nominalPeriod / 4) {
+                m_period.storeRelease(period + (sample - period) / HWC_PLUGIN_PERIOD_FILTER);
+                m_samples.fetchAndAddRelease(1);
+            }
+        }
+    }
+
+    if (delta > 0 || !lastVsync)
+        m_lastVsync.storeRelease(timestamp);
+
+    endWrite();
+}
+
+qint64 HwComposerVsyncTimeline::lastVsync() const
+{
+    return read().lastVsync;
+}
+
+qint64 HwComposerVsyncTimeline::period() const
+{
+    return read().period;
+}
+
+qint64 HwComposerVsyncTimeline::nextVsync(qint64 now) const
+{
+    Snapshot s = read();
+
+    if (!s.lastVsync || s.period <= 0)
+        return 0;
+
+    if (now < s.lastVsync)
+        return s.lastVsync;
+
+    qint64 periods = (now - s.lastVsync) / s.period + 1;
+    return s.lastVsync + periods * s.period;
+}
+
+bool HwComposerVsyncTimeline::isLocked(qint64 now) const
+{
+    Snapshot s = read();
+    return s.samples >= HWC_PLUGIN_LOCK_SAMPLES && s.period > 0 &&
+           now - s.lastVsync < HWC_PLUGIN_MAX_EXTRAPOLATION;
+}
+
+void HwComposerVsyncTimeline::requestResync()
+{
+    m_resyncRequested.storeRelease(1);
+}
+
+qint64 HwComposerVsyncTimeline::phaseError(qint64 timestamp) const
+{
+    Snapshot s = read();
+
+    if (!s.lastVsync || s.period <= 0)
+        return 0;
+
+    qint64 error = (timestamp - s.lastVsync) % s.period;
+    if (error < 0)
+        error += s.period;
+    if (error > s.period / 2)
+        error -= s.period;
+    return error;
+}
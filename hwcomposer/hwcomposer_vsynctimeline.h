@@ -0,0 +1,107 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_VSYNCTIMELINE_H
+#define HWCOMPOSER_VSYNCTIMELINE_H
+
+#include <QtGlobal>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+// Vsync timing of the display, built from the timestamps of the hwc vsync
+// events: the last vsync, a filtered period and from that a prediction of
+// the next vsync. All times are CLOCK_MONOTONIC in ns, as the hwc uses.
+//
+// Only the hwc vsync callback writes it, without locking, and readers retry
+// if they raced with an update (a sequence lock). The callback may run at
+// real-time priority, so it never waits for anyone: period changes and
+// resync requests from other threads are handed over through atomics and
+// applied with the next vsync, readers take them into account until then.
+class HwComposerVsyncTimeline
+{
+public:
+    HwComposerVsyncTimeline();
+
+    // Nominal period from the display config, used until vsyncs come in.
+    // Any thread.
+    void setNominalPeriod(qint64 periodNs);
+
+    // Called from the hwc vsync callback
+    void addVsync(qint64 timestamp);
+
+    qint64 lastVsync() const;
+    qint64 period() const;
+
+    // First vsync after now, 0 if no vsync has been seen yet. Less
+    // accurate after vsync events have been off for a long while.
+    qint64 nextVsync(qint64 now) const;
+
+    // Enough recent vsync samples to predict vsync without the hardware
+    bool isLocked(qint64 now) const;
+    // Distrust the model until a new burst of samples came in. Any thread.
+    void requestResync();
+    // Signed distance of timestamp to the closest predicted vsync
+    qint64 phaseError(qint64 timestamp) const;
+
+private:
+    struct Snapshot {
+        qint64 lastVsync;
+        qint64 period;
+        qint64 nominalPeriod;
+        int samples;
+    };
+
+    bool tryBeginWrite();
+    void endWrite();
+    Snapshot read() const;
+
+    QAtomicInt m_sequence;
+    // Requests for the writer, 0 if none
+    QAtomicInteger<qint64> m_requestedPeriod;
+    QAtomicInt m_resyncRequested;
+
+    QAtomicInteger<qint64> m_lastVsync;
+    QAtomicInteger<qint64> m_period;
+    QAtomicInteger<qint64> m_nominalPeriod;
+    // Period samples taken since the last resync
+    QAtomicInt m_samples;
+};
+
+#endif /* HWCOMPOSER_VSYNCTIMELINE_H */
@@ -0,0 +1,417 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "hwcomposer_window_v20.h"
+#include "hwcomposer_buffercount.h"
+#include "hwcomposer_framescheduler.h"
+#include "hwcomposer_startuptimeline.h"
+
+#include <QtCore/QElapsedTimer>
+
+#include "qsystrace_selector.h"
+
+#include <sync/sync.h>
+#include <unistd.h>
+
+// #define QPA_HWC_TIMING
+
+#ifdef QPA_HWC_TIMING
+#define QPA_HWC_TIMING_SAMPLE(variable) variable = timer.nsecsElapsed()
+static QElapsedTimer timer;
+static qint64 prepareTime;
+static qint64 setTime;
+#else
+#define QPA_HWC_TIMING_SAMPLE(variable)
+#endif
+
+// Client target slots the composer keeps per display, the size of an
+// Android BufferQueue, which is what the hwc2 device sets up on hotplug
+static const int HWC2_CLIENT_TARGET_SLOTS = 64;
+// Slot for direct scanout buffers. Their handles belong to the compositor
+// and may be reused for another buffer at any time, so they are always
+// sent in full and never looked up by handle.
+static const int HWC2_SCANOUT_TARGET_SLOT = HWC2_CLIENT_TARGET_SLOTS - 1;
+
+HWC2Window::HWC2Window(unsigned int width, unsigned int height,
+                    unsigned int format, hwc2_compat_display_t* display,
+                    hwc2_compat_layer_t *layer,
+                    HwComposerFenceMonitor::Listener *fenceListener) :
+                    HWComposerNativeWindow(width, height, format),
+                    layer(layer), hwcDisplay(display),
+                    m_fenceListener(fenceListener)
+{
+    int bufferCount = qgetenv("QPA_HWC_BUFFER_COUNT").toInt();
+    if (HwComposerBufferCountPolicy::isAdaptive()) {
+        m_bufferPolicy = new HwComposerBufferCountPolicy;
+        bufferCount = m_bufferPolicy->bufferCount();
+    } else if (bufferCount)
+        bufferCount = qBound(2, bufferCount, 8);
+    else
+        // default to triple-buffering as on Android
+        bufferCount = 3;
+    m_bufferCount.storeRelease(bufferCount);
+    setBufferCount(bufferCount);
+    m_syncBeforeSet = qEnvironmentVariableIsSet("QPA_HWC_SYNC_BEFORE_SET");
+    const QList<QByteArray> workarounds = qgetenv("QPA_HWC_WORKAROUNDS").split(',');
+    m_skipValidate = !workarounds.contains("no-skip-validate");
+    m_cacheClientTargets = !workarounds.contains("no-client-target-cache");
+    m_handleInSlot.fill(0, HWC2_CLIENT_TARGET_SLOTS);
+
+    if (HwComposerPresentThread::isEnabled())
+        m_presentThread = new HwComposerPresentThread(this, m_bufferPolicy ? 2 : bufferCount - 1);
+}
+
+HWC2Window::~HWC2Window()
+{
+    delete m_presentThread;
+    delete m_bufferPolicy;
+
+    releaseScanoutBuffer(-1);
+
+    if (m_validateChangesCount || m_validateErrorCount || m_acceptErrorCount) {
+        qDebug("HWC2Window: %d frames, validate changes %d, validate errors %d, accept errors %d, "
+               "%d presented without validate", m_frameCount, m_validateChangesCount,
+               m_validateErrorCount, m_acceptErrorCount, m_skipValidateCount);
+    }
+
+    if (lastPresentFence != -1) {
+        close(lastPresentFence);
+    }
+}
+
+void HWC2Window::setVsyncPeriod(qint64 periodNs)
+{
+    if (m_bufferPolicy)
+        m_bufferPolicy->setVsyncPeriod(periodNs);
+}
+
+void HWC2Window::setVsyncDivisor(int divisor)
+{
+    if (m_bufferPolicy)
+        m_bufferPolicy->setVsyncDivisor(divisor);
+}
+
+void HWC2Window::present(HWComposerNativeWindowBuffer *buffer)
+{
+    if (m_presentThread)
+        m_presentThread->queueBuffer(buffer, HwComposerFrame());
+    else
+        presentBuffer(buffer, HwComposerFrame());
+}
+
+int HWC2Window::dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fenceFd)
+{
+    // The native window never hands out the front buffer (the one queued
+    // last), so once everything older than that has been presented, any
+    // buffer we can get has its release fence set.
+    if (m_presentThread)
+        m_presentThread->waitForPending(1);
+
+    if (m_bufferPolicy && m_bufferPolicy->bufferCount() != bufferCount()) {
+        // The buffers get reallocated, queued ones have to be presented first
+        waitForPresent();
+        m_bufferCount.storeRelease(m_bufferPolicy->bufferCount());
+        setBufferCount(m_bufferPolicy->bufferCount());
+    }
+
+    return HWComposerNativeWindow::dequeueBuffer(buffer, fenceFd);
+}
+
+void HWC2Window::waitForPresent()
+{
+    if (m_presentThread)
+        m_presentThread->waitForPending(0);
+}
+
+void HWC2Window::presentBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame)
+{
+    // The hwc2 compatibility layer passes no damage for the client target,
+    // and overlays are turned down by the backend before they get here
+    Q_UNUSED(frame);
+
+    int presentFence = presentTarget(buffer, getFenceBufferFd(buffer));
+    setFenceBufferFd(buffer, presentFence);
+}
+
+int HWC2Window::setBufferCount(int cnt)
+{
+    invalidateClientTargetSlots();
+    return HWComposerNativeWindow::setBufferCount(cnt);
+}
+
+int HWC2Window::setBuffersFormat(int format)
+{
+    invalidateClientTargetSlots();
+    return HWComposerNativeWindow::setBuffersFormat(format);
+}
+
+int HWC2Window::setBuffersDimensions(int width, int height)
+{
+    invalidateClientTargetSlots();
+    return HWComposerNativeWindow::setBuffersDimensions(width, height);
+}
+
+uint32_t HWC2Window::clientTargetSlot(buffer_handle_t handle, bool *cached)
+{
+    QHash<buffer_handle_t, uint32_t>::const_iterator it = m_slotForHandle.constFind(handle);
+    if (it != m_slotForHandle.constEnd()) {
+        *cached = true;
+        return it.value();
+    }
+
+    // Slots are handed out round robin, the buffers of the window are
+    // used in turn
+    uint32_t slot = m_nextSlot;
+    m_nextSlot = (m_nextSlot + 1) % HWC2_SCANOUT_TARGET_SLOT;
+    if (m_handleInSlot.at(slot))
+        m_slotForHandle.remove(m_handleInSlot.at(slot));
+    m_handleInSlot[slot] = handle;
+    m_slotForHandle.insert(handle, slot);
+
+    *cached = false;
+    return slot;
+}
+
+void HWC2Window::invalidateClientTargetSlots()
+{
+    // Sending the handles again replaces what the composer has in the slots
+    QMutexLocker lock(&m_presentMutex);
+    m_slotForHandle.clear();
+    m_handleInSlot.fill(0);
+}
+
+void HWC2Window::invalidateLayerState()
+{
+    QMutexLocker lock(&m_presentMutex);
+    m_layerStateDirty = true;
+}
+
+bool HWC2Window::presentClientBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                                     HwComposerFenceMonitor::Listener *releaseListener, int releaseId)
+{
+    // Only buffers covering the whole display can replace the GL content
+    if (buffer->width != (int)width() || buffer->height != (int)height())
+        return false;
+
+    // GL frames queued before this buffer have to reach the display first
+    waitForPresent();
+
+    int presentFence = presentTarget(buffer, acquireFenceFd, releaseListener, releaseId);
+    if (presentFence != -1)
+        close(presentFence);
+    return true;
+}
+
+void HWC2Window::cancelBufferRelease(HwComposerFenceMonitor::Listener *releaseListener)
+{
+    QMutexLocker lock(&m_presentMutex);
+    if (m_scanoutListener == releaseListener)
+        m_scanoutListener = nullptr;
+}
+
+void HWC2Window::displayOff()
+{
+    // Nothing is scanned out anymore
+    QMutexLocker lock(&m_presentMutex);
+    releaseScanoutBuffer(-1);
+}
+
+void HWC2Window::releaseScanoutBuffer(int releaseFenceFd)
+{
+    // Called with m_presentMutex held, or from the destructor
+    if (!m_scanoutListener) {
+        if (releaseFenceFd != -1)
+            close(releaseFenceFd);
+        return;
+    }
+
+    HwComposerFenceMonitor::instance()->watchOrPoll(releaseFenceFd, m_scanoutListener, m_scanoutId);
+    m_scanoutListener = nullptr;
+}
+
+int HWC2Window::presentTarget(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                              HwComposerFenceMonitor::Listener *releaseListener, int releaseId)
+{
+    uint32_t numTypes = 0;
+    uint32_t numRequests = 0;
+    int displayId = 0;
+    hwc2_error_t error = HWC2_ERROR_NONE;
+
+    QSystraceEvent trace("graphics", "QPA::present");
+    QMutexLocker lock(&m_presentMutex);
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::FirstPresent);
+
+#ifdef QPA_HWC_TIMING
+    timer.start();
+#endif
+
+    if (m_syncBeforeSet && acquireFenceFd >= 0) {
+        sync_wait(acquireFenceFd, -1);
+        close(acquireFenceFd);
+        acquireFenceFd = -1;
+    }
+
+    m_frameCount++;
+
+    // A buffer the composer has seen goes by its slot only (a null handle),
+    // saving the composer from importing and mapping it again
+    uint32_t slot = 0;
+    ANativeWindowBuffer target = *buffer;
+    if (m_cacheClientTargets && releaseListener) {
+        slot = HWC2_SCANOUT_TARGET_SLOT;
+    } else if (m_cacheClientTargets) {
+        bool cached = false;
+        slot = clientTargetSlot(buffer->handle, &cached);
+        if (cached)
+            target.handle = NULL;
+    }
+
+    // The composer owns the acquire fence from here on
+    QSystrace::begin("graphics", "QPA::set_client_target", "");
+    hwc2_compat_display_set_client_target(hwcDisplay, slot, m_cacheClientTargets ? &target : buffer,
+                                          acquireFenceFd,
+                                          HAL_DATASPACE_UNKNOWN);
+    QSystrace::end("graphics", "QPA::set_client_target", "");
+
+    int presentFence = -1;
+    bool presented = false;
+
+    if (m_skipValidate && !m_layerStateDirty) {
+        // Only the client target changed since the last frame, so let the
+        // composer present right away unless it wants to validate anyway
+        uint32_t state = 0;
+        QSystrace::begin("graphics", "QPA::present_or_validate", "");
+        error = hwc2_compat_display_present_or_validate(hwcDisplay, &numTypes, &numRequests,
+                                                        &presentFence, &state);
+        QSystrace::end("graphics", "QPA::present_or_validate", "");
+        presented = (error == HWC2_ERROR_NONE && state == 1);
+        if (presented)
+            m_skipValidateCount++;
+        else if (error != HWC2_ERROR_NONE && error != HWC2_ERROR_HAS_CHANGES)
+            m_layerStateDirty = true;
+    }
+
+    if (m_layerStateDirty || !m_skipValidate) {
+        error = hwc2_compat_display_validate(hwcDisplay, &numTypes,
+                                                        &numRequests);
+    }
+
+    if (!presented) {
+        if (error != HWC2_ERROR_NONE && error != HWC2_ERROR_HAS_CHANGES) {
+            qDebug("prepare: validate failed for display %d: %d", displayId, error);
+            m_validateErrorCount++;
+            m_layerStateDirty = true;
+            // The buffer never made it to the display
+            if (releaseListener)
+                releaseListener->fenceSignaled(releaseId, HwComposerFenceMonitor::now());
+            return -1;
+        }
+
+        if (error == HWC2_ERROR_HAS_CHANGES || numTypes || numRequests) {
+            // Our only layer is client composited and the client target holds
+            // everything, so whatever composition types or display requests the
+            // composer asks for are fine with us. Accepting them makes the
+            // composer apply them to its layer state, and the frame goes on.
+            m_validateChangesCount++;
+            if (m_validateChangesCount == 1 || m_validateChangesCount % 100 == 0) {
+                qDebug("prepare: validate required changes for display %d (types %u, requests %u), "
+                       "%d of %d frames so far", displayId, numTypes, numRequests,
+                       m_validateChangesCount, m_frameCount);
+            }
+
+            error = hwc2_compat_display_accept_changes(hwcDisplay);
+            if (error != HWC2_ERROR_NONE) {
+                qDebug("prepare: acceptChanges failed: %d", error);
+                m_acceptErrorCount++;
+                m_layerStateDirty = true;
+                if (releaseListener)
+                    releaseListener->fenceSignaled(releaseId, HwComposerFenceMonitor::now());
+                return -1;
+            }
+        }
+
+        QPA_HWC_TIMING_SAMPLE(prepareTime);
+
+        QSystrace::begin("graphics", "QPA::present", "");
+        hwc2_compat_display_present(hwcDisplay, &presentFence);
+        QSystrace::end("graphics", "QPA::present", "");
+    }
+
+    m_layerStateDirty = false;
+
+    QPA_HWC_TIMING_SAMPLE(setTime);
+
+    // The backend throttles update delivery against the present fence
+    if (presentFence != -1) {
+        int fenceFd = dup(presentFence);
+        if (!HwComposerFenceMonitor::instance()->watch(fenceFd, m_fenceListener)) {
+            // Fence can't be polled, keep one frame in flight by blocking
+            if (lastPresentFence != -1) {
+                sync_wait(lastPresentFence, -1);
+                close(lastPresentFence);
+            }
+            lastPresentFence = fenceFd;
+        }
+    }
+
+    // The present fence signals when this frame starts scanning out, which
+    // is when the display let go of the client buffer shown before it. A
+    // client buffer presented now stays held until the next frame replaces it.
+    releaseScanoutBuffer(presentFence != -1 ? dup(presentFence) : -1);
+    if (releaseListener) {
+        m_scanoutListener = releaseListener;
+        m_scanoutId = releaseId;
+    }
+
+    qint64 target;
+    qint64 now = HwComposerFenceMonitor::now();
+    if (m_frameScheduler && m_frameScheduler->framePresented(now, &target) && m_bufferPolicy)
+        m_bufferPolicy->framePresented(target, now);
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::FirstPresent);
+
+#ifdef QPA_HWC_TIMING
+    qDebug("HWC2Window::presentTarget(), prepare=%.3f, set=%.3f, total=%.3f",
+           prepareTime / 1000000.0,
+           (setTime - prepareTime) / 1000000.0,
+           timer.nsecsElapsed() / 1000000.0);
+#endif
+
+    return presentFence;
+}
@@ -0,0 +1,137 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef HWCOMPOSER_WINDOW_V20_H
+#define HWCOMPOSER_WINDOW_V20_H
+
+#ifdef HWC_PLUGIN_HAVE_HWCOMPOSER1_API
+
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_presentthread.h"
+// libhybris access to the native hwcomposer window
+#include <hwcomposer_window.h>
+
+#include <hybris/hwc2/hwc2_compatibility_layer.h>
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QHash>
+#include <QVector>
+
+class HwComposerBufferCountPolicy;
+class HwComposerFrameScheduler;
+
+// The native window of the HWC2 backend, it presents each queued buffer as
+// the client target of the primary display
+class HWC2Window : public HWComposerNativeWindow, public HwComposerPresentThread::Client
+{
+    private:
+        hwc2_compat_layer_t *layer;
+        hwc2_compat_display_t *hwcDisplay;
+        int lastPresentFence = -1;
+        bool m_syncBeforeSet;
+        HwComposerFenceMonitor::Listener *m_fenceListener;
+        HwComposerPresentThread *m_presentThread = nullptr;
+        HwComposerBufferCountPolicy *m_bufferPolicy = nullptr;
+        HwComposerFrameScheduler *m_frameScheduler = nullptr;
+        QAtomicInt m_bufferCount;
+        QMutex m_presentMutex;
+
+        // How often the composer made us negotiate, or failed us
+        int m_frameCount = 0;
+        int m_validateChangesCount = 0;
+        int m_validateErrorCount = 0;
+        int m_acceptErrorCount = 0;
+        int m_skipValidateCount = 0;
+
+        // Layer state changed since the last present, validate has to run
+        bool m_layerStateDirty = true;
+        bool m_skipValidate;
+
+        // Client target slot of each buffer the composer has imported
+        bool m_cacheClientTargets;
+        QHash<buffer_handle_t, uint32_t> m_slotForHandle;
+        QVector<buffer_handle_t> m_handleInSlot;
+        uint32_t m_nextSlot = 0;
+
+        // Client buffer on screen, released by the present of the next frame
+        HwComposerFenceMonitor::Listener *m_scanoutListener = nullptr;
+        int m_scanoutId = 0;
+
+        uint32_t clientTargetSlot(buffer_handle_t handle, bool *cached);
+        void invalidateClientTargetSlots();
+        void releaseScanoutBuffer(int releaseFenceFd);
+
+        int presentTarget(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                          HwComposerFenceMonitor::Listener *releaseListener = nullptr, int releaseId = 0);
+    protected:
+        void present(HWComposerNativeWindowBuffer *buffer);
+        int dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fenceFd);
+
+        // These reallocate the buffers, and handles may get reused
+        int setBufferCount(int cnt);
+        int setBuffersFormat(int format);
+        int setBuffersDimensions(int width, int height);
+
+    public:
+
+        HWC2Window(unsigned int width, unsigned int height, unsigned int format,
+                hwc2_compat_display_t *display, hwc2_compat_layer_t *layer,
+                HwComposerFenceMonitor::Listener *fenceListener);
+        ~HWC2Window();
+        void set();
+
+        void presentBuffer(HWComposerNativeWindowBuffer *buffer, const HwComposerFrame &frame) Q_DECL_OVERRIDE;
+        bool presentClientBuffer(ANativeWindowBuffer *buffer, int acquireFenceFd,
+                                 HwComposerFenceMonitor::Listener *releaseListener, int releaseId);
+        void cancelBufferRelease(HwComposerFenceMonitor::Listener *releaseListener);
+        void displayOff();
+        void waitForPresent();
+        void invalidateLayerState();
+
+        void setVsyncPeriod(qint64 periodNs);
+        void setVsyncDivisor(int divisor);
+        void setFrameScheduler(HwComposerFrameScheduler *scheduler) { m_frameScheduler = scheduler; }
+        int bufferCount() const { return m_bufferCount.loadAcquire(); }
+};
+
+#endif /* HWC_PLUGIN_HAVE_HWCOMPOSER1_API */
+
+#endif /* HWCOMPOSER_WINDOW_V20_H */
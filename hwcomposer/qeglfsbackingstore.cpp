@@ -81,11 +81,13 @@ QPaintDevice *QEglFSBackingStore::paintDevice()
 
 void QEglFSBackingStore::flush(QWindow *window, const QRegion &region, const QPoint &offset)
 {
-    Q_UNUSED(region);
     Q_UNUSED(offset);
 
     makeCurrent();
 
+    // Everything uploaded or flushed now is what changes on screen
+    QRegion damage = (m_dirty | region).translated(window->geometry().topLeft());
+
 #ifdef QEGL_EXTRA_DEBUG
     qWarning("QEglBackingStore::flush %p", window);
 #endif
@@ -196,6 +198,7 @@ void QEglFSBackingStore::flush(QWindow *window, const QRegion &region, const QPo
     glDisableVertexAttribArray(m_vertexCoordEntry);
     glDisableVertexAttribArray(m_textureCoordEntry);
 
+    static_cast<QEglFSWindow *>(window->handle())->setSwapDamage(damage);
     m_context->swapBuffers(window);
 
     m_context->doneCurrent();
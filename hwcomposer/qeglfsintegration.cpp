@@ -75,10 +75,21 @@
 #include <QtGui/QOpenGLContext>
 #include <QtGui/QScreen>
 #include <QtGui/QOffscreenSurface>
+#include <QtGui/QFontDatabase>
+#include <QtCore/qmath.h>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 
 #include <qpa/qplatforminputcontextfactory_p.h>
 
 #include "qeglfscontext.h"
+#include "qeglfspageflipper.h"
+#include "hwcomposer_backend.h"
+#include "hwcomposer_startuptimeline.h"
+#include "hwcomposer_blobcache.h"
 
 #include <EGL/egl.h>
 
@@ -93,16 +104,85 @@ public:
     }
 };
 
+// Opens the hwc on a pool thread. Probing the device, starting libminisf,
+// waiting for the display to be hotplugged and reading its values don't
+// need the gui thread, which meanwhile initializes EGL.
+class HwComposerStartup : public QRunnable
+{
+public:
+    HwComposerStartup()
+        : m_guiThread(QThread::currentThread())
+        , m_context(NULL)
+        , m_elapsed(0)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() Q_DECL_OVERRIDE
+    {
+        QElapsedTimer timer;
+        timer.start();
+        m_context = new HwComposerContext();
+        // In case the backend had nothing to load
+        HwComposerBackend::markLibrariesLoaded();
+        m_context->moveToThread(m_guiThread);
+        m_elapsed = timer.elapsed();
+        m_done.release();
+    }
+
+    HwComposerContext *waitForContext()
+    {
+        m_done.acquire();
+        return m_context;
+    }
+
+    qint64 elapsed() const { return m_elapsed; }
+
+private:
+    QThread *m_guiThread;
+    HwComposerContext *m_context;
+    qint64 m_elapsed;
+    QSemaphore m_done;
+};
+
+// Runs QEglFSIntegration::firstFrameShown() when the first swap has been
+// done and the gui thread got through the events queued up until then
+class HwComposerFirstFrameReceiver : public QObject
+{
+public:
+    explicit HwComposerFirstFrameReceiver(QEglFSIntegration *integration)
+        : m_integration(integration)
+    {
+    }
+
+    bool event(QEvent *e) Q_DECL_OVERRIDE
+    {
+        if (e->type() != QEvent::User)
+            return QObject::event(e);
+
+        m_integration->firstFrameShown();
+        return true;
+    }
+
+private:
+    QEglFSIntegration *m_integration;
+};
+
 QEglFSIntegration::QEglFSIntegration()
     : mHwc(NULL)
     , mEventDispatcher(createUnixEventDispatcher())
-    , mFontDb(new QGenericUnixFontDatabase())
+    , mScreen(NULL)
+    , mFirstFrameReceiver(NULL)
+    , mFontDb(NULL)
+    , mInputContext(NULL)
+    , mInputContextCreated(false)
 {
 #if QT_VERSION < QT_VERSION_CHECK(5, 2, 0)
     QGuiApplicationPrivate::instance()->setEventDispatcher(mEventDispatcher);
 #endif
 
-    mHwc = new HwComposerContext();
+    QElapsedTimer timer;
+    timer.start();
 
     EGLint major, minor;
 
@@ -111,16 +191,50 @@ QEglFSIntegration::QEglFSIntegration()
         qFatal("EGL error");
     }
 
-    mDisplay = eglGetDisplay(mHwc->platformDisplay());
+    // Some hwc modules want the framebuffer opened before them, which
+    // getting the display does. Every backend uses the default display, so
+    // it doesn't have to wait for the hwc.
+    bool framebufferFirst = qEnvironmentVariableIsEmpty("QT_QPA_NO_FRAMEBUFFER_FIRST");
+    if (framebufferFirst)
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    qint64 eglBound = timer.elapsed();
+
+    // The screen needs both the hwc and EGL, nothing else depends on the
+    // hwc. QPA_HWC_WORKAROUNDS=serial-startup opens it right here like it
+    // used to be done.
+    HwComposerStartup hwcStartup;
+    bool parallel = !qgetenv("QPA_HWC_WORKAROUNDS").split(',').contains("serial-startup");
+    if (parallel && !QThreadPool::globalInstance()->tryStart(&hwcStartup))
+        parallel = false;
+    if (!parallel)
+        hwcStartup.run();
+
+    // libhybris loads libraries without a lock, so EGL loads its driver
+    // only once the hwc is done with its own. The hotplug wait and reading
+    // the display values still overlap initializing EGL.
+    HwComposerBackend::waitForLibraries();
+    qint64 librariesDone = timer.elapsed();
+
+    if (!framebufferFirst)
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     if (mDisplay == EGL_NO_DISPLAY) {
         qWarning("Could not open egl display\n");
         qFatal("EGL error");
     }
 
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::EglInitialize);
     if (!eglInitialize(mDisplay, &major, &minor)) {
         qWarning("Could not initialize egl display\n");
         qFatal("EGL error");
     }
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::EglInitialize);
+
+    // Before any context compiles a shader
+    HwComposerBlobCache::install(mDisplay);
+    qint64 eglDone = timer.elapsed();
+
+    mHwc = hwcStartup.waitForContext();
+    qint64 hwcDone = timer.elapsed();
 
     mScreen = new QEglFSScreen(mHwc, mDisplay);
 #if QT_VERSION < QT_VERSION_CHECK(5, 13, 0)
@@ -128,12 +242,23 @@ QEglFSIntegration::QEglFSIntegration()
 #else
     QWindowSystemInterface::handleScreenAdded(mScreen);
 #endif
+    qint64 screenDone = timer.elapsed();
 
-    mInputContext = QPlatformInputContextFactory::create();
+    qDebug("Start-up %s: egl binding %lld ms, hwc %lld ms (libraries after %lld ms), "
+           "egl %lld ms, waited for the hwc %lld ms, screen %lld ms, total %lld ms",
+           parallel ? "in parallel" : "in sequence",
+           eglBound, hwcStartup.elapsed(), librariesDone - eglBound,
+           eglDone - librariesDone, hwcDone - eglDone, screenDone - hwcDone, screenDone);
+
+    mFirstFrameReceiver = new HwComposerFirstFrameReceiver(this);
+    mHwc->setFirstSwapReceiver(mFirstFrameReceiver);
 }
 
 QEglFSIntegration::~QEglFSIntegration()
 {
+    mHwc->setFirstSwapReceiver(NULL);
+    delete mFirstFrameReceiver;
+
 #if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
     QWindowSystemInterface::handleScreenRemoved(mScreen);
 #elif QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
@@ -142,6 +267,7 @@ QEglFSIntegration::~QEglFSIntegration()
     delete mScreen;
 #endif
 
+    HwComposerBlobCache::instance()->flush();
     eglTerminate(mDisplay);
     delete mHwc;
 }
@@ -186,7 +312,66 @@ QPlatformOffscreenSurface *QEglFSIntegration::createPlatformOffscreenSurface(QOf
 
 QPlatformFontDatabase *QEglFSIntegration::fontDatabase() const
 {
-    return mFontDb;
+    // QFontDatabase may get here from any thread
+    QPlatformFontDatabase *fontDb = mFontDb.loadAcquire();
+    if (!fontDb) {
+        fontDb = new QGenericUnixFontDatabase();
+        if (!mFontDb.testAndSetOrdered(NULL, fontDb)) {
+            delete fontDb;
+            fontDb = mFontDb.loadAcquire();
+        }
+    }
+    return fontDb;
+}
+
+QPlatformInputContext *QEglFSIntegration::inputContext() const
+{
+    // Only asked for on the gui thread. Input method plugins tend to
+    // connect to their server when created, so don't try again on failure.
+    if (!mInputContextCreated) {
+        mInputContextCreated = true;
+        mInputContext = QPlatformInputContextFactory::create();
+    }
+    return mInputContext;
+}
+
+void QEglFSIntegration::firstFrameShown()
+{
+    // Querying the hwc is only safe here, not while start-up runs
+    mHwc->verifyProbeCache();
+
+    if (!qEnvironmentVariableIsEmpty("QPA_HWC_PREWARM"))
+        prewarm();
+}
+
+void QEglFSIntegration::prewarm()
+{
+    const QList<QByteArray> subsystems = qgetenv("QPA_HWC_PREWARM").split(',');
+    bool all = subsystems.contains("all");
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (all || subsystems.contains("fonts")) {
+        // Scanning the installed fonts is the expensive part
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+        QFontDatabase::families();
+#else
+        QFontDatabase().families();
+#endif
+    }
+    qint64 fontsDone = timer.elapsed();
+
+    if (all || subsystems.contains("inputcontext"))
+        inputContext();
+    qint64 inputContextDone = timer.elapsed();
+
+    if (all || subsystems.contains("sensors"))
+        static_cast<QEglFSScreen *>(mScreen)->startOrientationSensor();
+    qint64 sensorsDone = timer.elapsed();
+
+    qDebug("Prewarmed after the first frame: fonts %lld ms, input context %lld ms, sensors %lld ms",
+           fontsDone, inputContextDone - fontsDone, sensorsDone - inputContextDone);
 }
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 2, 0)
@@ -230,6 +415,145 @@ void *QEglFSIntegration::nativeResourceForIntegration(const QByteArray &resource
     return NULL;
 }
 
+static void setSwapDamage(QWindow *window, const QRegion &damage)
+{
+    if (window && window->handle())
+        static_cast<QEglFSWindow *>(window->handle())->setSwapDamage(damage);
+}
+
+static void setOverlayLayers(QWindow *window, const HwcOverlayLayer *layers, int count)
+{
+    QVector<HwcOverlayLayer> overlays;
+    for (int i = 0; i < count; i++) {
+        if (window && window->handle() && layers[i].buffer)
+            overlays.append(layers[i]);
+        else
+            HwComposerBackend::rejectOverlayLayer(layers[i]);
+    }
+
+    if (window && window->handle())
+        static_cast<QEglFSWindow *>(window->handle())->setOverlayLayers(overlays);
+}
+
+static void setVsyncDivisor(QWindow *window, int divisor)
+{
+    if (window && window->handle())
+        static_cast<QEglFSWindow *>(window->handle())->setVsyncDivisor(divisor);
+}
+
+static void setMaximumFrameRate(QWindow *window, qreal fps)
+{
+    if (!window)
+        return;
+
+    // The highest rate the display can do at or below fps, if any
+    qreal refreshRate = window->screen() ? window->screen()->refreshRate() : 60.0;
+    setVsyncDivisor(window, fps > 0 ? qCeil(refreshRate / fps - 0.01) : 1);
+}
+
+static QEglFSPageFlipper *pageFlipperForScreen(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return 0;
+    return static_cast<QEglFSScreen *>(screen->handle())->pageFlipper();
+}
+
+static bool displayBuffer(QScreen *screen, const HwcScanoutBuffer *buffer)
+{
+    QEglFSPageFlipper *flipper = pageFlipperForScreen(screen);
+    return flipper && buffer && flipper->displayBuffer(*buffer);
+}
+
+static void setDirectRenderingActive(QScreen *screen, bool active)
+{
+    if (QEglFSPageFlipper *flipper = pageFlipperForScreen(screen))
+        flipper->setDirectRenderingActive(active);
+}
+
+static int bufferCount(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return 0;
+    return static_cast<QEglFSScreen *>(screen->handle())->bufferCount();
+}
+
+static bool setDisplayMode(QScreen *screen, int index)
+{
+    if (!screen || !screen->handle())
+        return false;
+    return static_cast<QEglFSScreen *>(screen->handle())->setDisplayMode(index);
+}
+
+static qint64 nextVsyncNs(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return 0;
+    return static_cast<QEglFSScreen *>(screen->handle())->nextVsync();
+}
+
+static qint64 vsyncPeriodNs(QScreen *screen)
+{
+    if (!screen || !screen->handle())
+        return 0;
+    return static_cast<QEglFSScreen *>(screen->handle())->vsyncPeriod();
+}
+
+QPlatformNativeInterface::NativeResourceForIntegrationFunction QEglFSIntegration::nativeResourceFunctionForIntegration(const QByteArray &resource)
+{
+    QByteArray lowerCaseResource = resource.toLower();
+
+    // void setSwapDamage(QWindow *window, const QRegion &damage), to be
+    // called before swapping the window from the rendering thread
+    if (lowerCaseResource == "setswapdamage")
+        return NativeResourceForIntegrationFunction(setSwapDamage);
+
+    // void setOverlayLayers(QWindow *window, const HwcOverlayLayer *layers, int count),
+    // see hwcomposer_overlay.h
+    if (lowerCaseResource == "setoverlaylayers")
+        return NativeResourceForIntegrationFunction(setOverlayLayers);
+
+    // void setVsyncDivisor(QWindow *window, int divisor) and
+    // void setMaximumFrameRate(QWindow *window, qreal fps), deliver update
+    // requests of the window only every divisor-th vsync (1-8), or at the
+    // highest rate the display allows within fps; 0 lifts the cap
+    if (lowerCaseResource == "setvsyncdivisor")
+        return NativeResourceForIntegrationFunction(setVsyncDivisor);
+    if (lowerCaseResource == "setmaximumframerate")
+        return NativeResourceForIntegrationFunction(setMaximumFrameRate);
+
+    // bool displayBuffer(QScreen *screen, const HwcScanoutBuffer *buffer) and
+    // void setDirectRenderingActive(QScreen *screen, bool active),
+    // see hwcomposer_overlay.h
+    if (lowerCaseResource == "displaybuffer")
+        return NativeResourceForIntegrationFunction(displayBuffer);
+    if (lowerCaseResource == "setdirectrenderingactive")
+        return NativeResourceForIntegrationFunction(setDirectRenderingActive);
+
+    // int bufferCount(QScreen *screen), the swap chain depth for
+    // diagnostics, 0 if unknown
+    if (lowerCaseResource == "buffercount")
+        return NativeResourceForIntegrationFunction(bufferCount);
+
+    // qint64 nextVsyncNs(QScreen *screen) and qint64 vsyncPeriodNs(QScreen *screen),
+    // CLOCK_MONOTONIC times in ns predicted from the hwc vsync events, 0 if unknown
+    if (lowerCaseResource == "nextvsyncns")
+        return NativeResourceForIntegrationFunction(nextVsyncNs);
+    if (lowerCaseResource == "vsyncperiodns")
+        return NativeResourceForIntegrationFunction(vsyncPeriodNs);
+
+    // bool setDisplayMode(QScreen *screen, int index), switch to another
+    // entry of QScreen::modes() (Qt 5.9+), only the refresh rate may differ
+    if (lowerCaseResource == "setdisplaymode")
+        return NativeResourceForIntegrationFunction(setDisplayMode);
+
+    // QByteArray startupTimeline(), the start-up phases recorded so far as
+    // Trace Event Format JSON, see hwcomposer_startuptimeline.h
+    if (lowerCaseResource == "startuptimeline")
+        return NativeResourceForIntegrationFunction(HwComposerStartupTimeline::toJson);
+
+    return 0;
+}
+
 void *QEglFSIntegration::nativeResourceForWindow(const QByteArray &resource, QWindow *window)
 {
     QByteArray lowerCaseResource = resource.toLower();
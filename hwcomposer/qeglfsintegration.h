@@ -50,6 +50,8 @@
 #include <qpa/qplatformnativeinterface.h>
 #include <qpa/qplatformscreen.h>
 
+#include <QtCore/QAtomicPointer>
+
 QT_BEGIN_NAMESPACE
 
 class QEglFSIntegration : public QPlatformIntegration, public QPlatformNativeInterface
@@ -80,25 +82,35 @@ public:
     void *nativeResourceForIntegration(const QByteArray &resource);
     void *nativeResourceForWindow(const QByteArray &resource, QWindow *window) Q_DECL_OVERRIDE;
     void *nativeResourceForContext(const QByteArray &resource, QOpenGLContext *context);
+    NativeResourceForIntegrationFunction nativeResourceFunctionForIntegration(const QByteArray &resource) Q_DECL_OVERRIDE;
 
     QPlatformScreen *screen() const { return mScreen; }
     static EGLConfig chooseConfig(EGLDisplay display, const QSurfaceFormat &format);
 
     EGLDisplay display() const { return mDisplay; }
 
-    QPlatformInputContext *inputContext() const { return mInputContext; }
+    QPlatformInputContext *inputContext() const;
 
     QStringList themeNames() const;
 
     QPlatformTheme *createPlatformTheme(const QString &name) const;
 
+    // Called once the first frame is on screen
+    void firstFrameShown();
+    // Builds what QPA_HWC_PREWARM lists ahead of first use
+    void prewarm();
+
 private:
     HwComposerContext *mHwc;
     EGLDisplay mDisplay;
     QAbstractEventDispatcher *mEventDispatcher;
-    QPlatformFontDatabase *mFontDb;
     QPlatformScreen *mScreen;
-    QPlatformInputContext *mInputContext;
+    QObject *mFirstFrameReceiver;
+
+    // Created on first use, compositors often need neither
+    mutable QAtomicPointer<QPlatformFontDatabase> mFontDb;
+    mutable QPlatformInputContext *mInputContext;
+    mutable bool mInputContextCreated;
 };
 
 QT_END_NAMESPACE
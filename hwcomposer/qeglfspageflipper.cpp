@@ -39,51 +39,74 @@
  * **
  * ****************************************************************************/
 
-#include "qeglfspageflipper.h"
-
-#include <qpa/qplatformscreen.h>
 
+#include "qeglfspageflipper.h"
+#include "hwcomposer_context.h"
 
-#include <sys/mman.h>
-#include <memory.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <stdio.h>
+#include <QtCore/QDebug>
 
 QT_BEGIN_NAMESPACE
 
-QEglFSPageFlipper::QEglFSPageFlipper(QPlatformScreen *screen)
-    : m_screen(screen), m_buffer(0), m_active(false)
+QEglFSPageFlipper::QEglFSPageFlipper(HwComposerContext *hwc)
+    : m_hwc(hwc), m_nextId(0), m_active(false)
 {
 }
 
 QEglFSPageFlipper::~QEglFSPageFlipper()
 {
-    if (m_buffer)
-        m_buffer->release();
+    // No fenceSignaled() calls after this, release what is still out
+    HwComposerFenceMonitor::instance()->removeListener(this);
+    m_hwc->cancelBufferRelease(this);
+
+    const QList<HwcScanoutBuffer> pending = m_pending.values();
+    m_pending.clear();
+    for (const HwcScanoutBuffer &buffer : pending) {
+        if (buffer.release)
+            buffer.release(buffer.userData);
+    }
 }
 
-bool QEglFSPageFlipper::displayBuffer(QPlatformScreenBuffer *buffer)
+bool QEglFSPageFlipper::displayBuffer(const HwcScanoutBuffer &buffer)
 {
-    // TODO: Implement support for flipping the buffer to screen
-    qWarning("QEglFSPageFlipper::displayBuffer unimplemented in hwcomposer");
-    buffer->displayed();
+    if (!m_active || !buffer.buffer)
+        return false;
 
+    // The backend reports the release through fenceSignaled(), possibly
+    // before displayBuffer() returns, so the buffer has to be known by then
+    int id = ++m_nextId;
+    m_pending.insert(id, buffer);
+    if (!m_hwc->displayBuffer(buffer.buffer, buffer.acquireFenceFd, this, id)) {
+        m_pending.remove(id);
+        return false;
+    }
 
-    if (m_buffer)
-        m_buffer->release();
-    m_buffer = buffer;
+    if (buffer.displayed)
+        buffer.displayed(buffer.userData);
 
     return true;
 }
 
+void QEglFSPageFlipper::fenceSignaled(int id, qint64 timestamp)
+{
+    Q_UNUSED(timestamp);
+
+    // Called on the fence monitor thread, the release callback belongs
+    // to the thread of the screen
+    QMetaObject::invokeMethod(this, "releaseBuffer", Qt::QueuedConnection, Q_ARG(int, id));
+}
+
+void QEglFSPageFlipper::releaseBuffer(int id)
+{
+    HwcScanoutBuffer buffer = m_pending.take(id);
+    if (buffer.buffer && buffer.release)
+        buffer.release(buffer.userData);
+}
+
 void QEglFSPageFlipper::setDirectRenderingActive(bool active)
 {
+    // Buffers still on screen are released by the backend once the frames
+    // replacing them, GL or direct, reached the display.
     m_active = active;
-    if (!active && m_buffer) {
-        m_buffer->release();
-        m_buffer = 0;
-    }
 }
 
 QT_END_NAMESPACE
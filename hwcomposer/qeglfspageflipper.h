@@ -39,32 +39,44 @@
  * **
  * ****************************************************************************/
 
+
 #ifndef QEGLFSPAGEFLIPPER_H
 #define QEGLFSPAGEFLIPPER_H
 
-#include <qpa/qplatformscreenpageflipper.h>
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_overlay.h"
 
 QT_BEGIN_NAMESPACE
 
-class QPlatformScreen;
+class HwComposerContext;
 
-class QEglFSPageFlipper : public QPlatformScreenPageFlipper
+// Scans out full-screen client buffers in place of the GL content, see
+// HwcScanoutBuffer for the contract with the compositor.
+class QEglFSPageFlipper : public QObject, public HwComposerFenceMonitor::Listener
 {
   Q_OBJECT
 
 public:
-    QEglFSPageFlipper(QPlatformScreen *screen);
+    QEglFSPageFlipper(HwComposerContext *hwc);
     ~QEglFSPageFlipper();
 
-    bool displayBuffer(QPlatformScreenBuffer *buffer);
+    bool displayBuffer(const HwcScanoutBuffer &buffer);
 
     bool isActive() const { return m_active; }
+    void setDirectRenderingActive(bool active);
+
+    void fenceSignaled(int id, qint64 timestamp) Q_DECL_OVERRIDE;
 
 private:
-    Q_INVOKABLE void setDirectRenderingActive(bool active);
+    Q_INVOKABLE void releaseBuffer(int id);
 
-    QPlatformScreen *m_screen;
-    QPlatformScreenBuffer *m_buffer;
+    HwComposerContext *m_hwc;
+    // Buffers handed to the display and not released yet, by release id
+    QHash<int, HwcScanoutBuffer> m_pending;
+    int m_nextId;
     bool m_active;
 };
 
@@ -41,15 +41,18 @@
 
 #include "qeglfsscreen.h"
 #include "qeglfswindow.h"
+#include "qeglfspageflipper.h"
+#include "hwcomposer_fencemonitor.h"
+#include "hwcomposer_vsynctimeline.h"
 
 #include <private/qmath_p.h>
+#include <qpa/qwindowsysteminterface.h>
 
 #ifdef WITH_SENSORS
 #include <QtSensors/QSensorManager>
 #include <QtSensors/QOrientationSensor>
 #include <QtSensors/QOrientationFilter>
 #include <QtSensors/QOrientationReading>
-#include <qpa/qwindowsysteminterface.h>
 
 #include <QTimer>
 #endif
@@ -58,10 +61,12 @@ QT_BEGIN_NAMESPACE
 
 QEglFSScreen::QEglFSScreen(HwComposerContext *hwc, EGLDisplay dpy)
     : m_hwc(hwc)
+    , m_pageFlipper(new QEglFSPageFlipper(hwc))
     , m_dpy(dpy)
+    , m_preferredMode(hwc->activeDisplayMode())
 #ifdef WITH_SENSORS
     , m_screenOrientation(Qt::PrimaryOrientation)
-    , m_orientationSensor(new QOrientationSensor(this))
+    , m_orientationSensor(NULL)
 #endif
 {
 #ifdef QEGL_EXTRA_DEBUG
@@ -72,6 +77,8 @@ QEglFSScreen::QEglFSScreen(HwComposerContext *hwc, EGLDisplay dpy)
 
 QEglFSScreen::~QEglFSScreen()
 {
+    delete m_pageFlipper;
+
 #ifdef WITH_SENSORS
     if (m_orientationSensor) {
         m_orientationSensor->stop();
@@ -80,6 +87,19 @@ QEglFSScreen::~QEglFSScreen()
 #endif
 }
 
+void QEglFSScreen::startOrientationSensor()
+{
+#ifdef WITH_SENSORS
+    if (!m_orientationSensor) {
+        m_orientationSensor = new QOrientationSensor(this);
+        connect(m_orientationSensor, &QOrientationSensor::readingChanged,
+                this, &QEglFSScreen::orientationReadingChanged);
+    }
+
+    onStarted();
+#endif
+}
+
 #ifdef WITH_SENSORS
 void QEglFSScreen::onStarted()
 {
@@ -129,6 +149,51 @@ qreal QEglFSScreen::refreshRate() const
     return m_hwc->refreshRate();
 }
 
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 9, 0))
+QVector<QPlatformScreen::Mode> QEglFSScreen::modes() const
+{
+    typedef QPair<QSize, qreal> DisplayMode;
+    QVector<QPlatformScreen::Mode> modes;
+    foreach (const DisplayMode &mode, m_hwc->displayModes()) {
+        QPlatformScreen::Mode m = { mode.first, mode.second };
+        modes.append(m);
+    }
+
+    if (modes.isEmpty())
+        return QPlatformScreen::modes();
+    return modes;
+}
+
+int QEglFSScreen::currentMode() const
+{
+    return qMax(0, m_hwc->activeDisplayMode());
+}
+
+int QEglFSScreen::preferredMode() const
+{
+    return qMax(0, m_preferredMode);
+}
+#endif
+
+bool QEglFSScreen::setDisplayMode(int index)
+{
+    if (!m_hwc->setActiveDisplayMode(index))
+        return false;
+
+    QWindowSystemInterface::handleScreenRefreshRateChange(screen(), refreshRate());
+    return true;
+}
+
+qint64 QEglFSScreen::nextVsync() const
+{
+    return m_hwc->vsyncTimeline()->nextVsync(HwComposerFenceMonitor::now());
+}
+
+qint64 QEglFSScreen::vsyncPeriod() const
+{
+    return m_hwc->vsyncTimeline()->period();
+}
+
 #ifdef WITH_SENSORS
 void QEglFSScreen::orientationReadingChanged()
 {
@@ -138,7 +203,11 @@ void QEglFSScreen::orientationReadingChanged()
         screenPrimaryOrientation = Qt::LandscapeOrientation;
     }
 
+    if (!m_orientationSensor)
+        return;
     QOrientationReading *orientationReading = m_orientationSensor->reading();
+    if (!orientationReading)
+        return;
     QOrientationReading::Orientation currentOrientation = orientationReading->orientation();
 
     switch (currentOrientation) {
@@ -166,6 +235,18 @@ Qt::ScreenOrientation QEglFSScreen::orientation() const
 {
     return m_screenOrientation;
 }
+
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+void QEglFSScreen::setOrientationUpdateMask(Qt::ScreenOrientations mask)
+{
+    // QScreen reads orientation() once while it is created, so that can't
+    // start the sensor. The first ask for orientation changes does.
+    if (mask)
+        startOrientationSensor();
+    else if (m_orientationSensor)
+        m_orientationSensor->stop();
+}
+#endif
 #endif
 
 QPlatformScreen::PowerState QEglFSScreen::powerState() const
@@ -81,22 +81,42 @@ public:
 
     qreal refreshRate() const;
 
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 9, 0))
+    QVector<QPlatformScreen::Mode> modes() const override;
+    int currentMode() const override;
+    int preferredMode() const override;
+#endif
+
+    // Switch to another display mode at the same resolution
+    bool setDisplayMode(int index);
+
 #ifdef WITH_SENSORS
     Qt::ScreenOrientation orientation() const;
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    void setOrientationUpdateMask(Qt::ScreenOrientations mask) override;
+#endif
 #endif
 
+    // The orientation sensor only runs once someone follows orientation
+    // changes, no-op without sensors
+    void startOrientationSensor();
+
     QPlatformScreen::PowerState powerState() const override;
     void setPowerState(QPlatformScreen::PowerState state) override;
 
-#if 0
-    QPlatformScreenPageFlipper *pageFlipper() const;
-#endif
+    QEglFSPageFlipper *pageFlipper() const { return m_pageFlipper; }
+    int bufferCount() const { return m_hwc->bufferCount(); }
+
+    // CLOCK_MONOTONIC times in ns, 0 if unknown
+    qint64 nextVsync() const;
+    qint64 vsyncPeriod() const;
 
 private:
     HwComposerContext *m_hwc;
     QEglFSPageFlipper *m_pageFlipper;
     EGLDisplay m_dpy;
     PowerState m_powerState;
+    int m_preferredMode;
 #ifdef WITH_SENSORS
     Qt::ScreenOrientation m_screenOrientation;
     QOrientationSensor *m_orientationSensor;
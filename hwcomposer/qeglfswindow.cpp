@@ -40,6 +40,8 @@
 ****************************************************************************/
 
 #include "qeglfswindow.h"
+#include "hwcomposer_backend.h"
+#include "hwcomposer_startuptimeline.h"
 #include <qpa/qwindowsysteminterface.h>
 
 #if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
@@ -59,6 +61,8 @@ QEglFSWindow::QEglFSWindow(HwComposerContext *hwc, QWindow *w)
     , m_surface(0)
     , m_window(0)
     , m_hwc(hwc)
+    , m_vsyncDivisor(qBound(1, qgetenv("QPA_HWC_VSYNC_DIVISOR").toInt(), 8))
+    , m_lastUpdateVsync(0)
 {
 #ifdef QEGL_EXTRA_DEBUG
     qWarning("QEglWindow %p: %p 0x%x\n", this, w, uint(m_window));
@@ -107,7 +111,9 @@ void QEglFSWindow::resetSurface()
     EGLDisplay display = static_cast<QEglFSScreen *>(screen())->display();
 
     m_window = m_hwc->createNativeWindow(m_format);
+    HwComposerStartupTimeline::begin(HwComposerStartupTimeline::FirstWindowSurface);
     m_surface = eglCreateWindowSurface(display, m_config, m_window, NULL);
+    HwComposerStartupTimeline::end(HwComposerStartupTimeline::FirstWindowSurface);
     if (m_surface == EGL_NO_SURFACE) {
         EGLint error = eglGetError();
         eglTerminate(display);
@@ -159,4 +165,42 @@ void QEglFSWindow::requestUpdate()
         QPlatformWindow::requestUpdate();
 }
 
+QRegion QEglFSWindow::takeSwapDamage()
+{
+    QRegion damage = m_swapDamage;
+    m_swapDamage = QRegion();
+    return damage;
+}
+
+void QEglFSWindow::setOverlayLayers(const QVector<HwcOverlayLayer> &layers)
+{
+    // Overlays that were set but never swapped still need to be reported
+    foreach (const HwcOverlayLayer &layer, m_overlayLayers)
+        HwComposerBackend::rejectOverlayLayer(layer);
+
+    m_overlayLayers = layers;
+}
+
+QVector<HwcOverlayLayer> QEglFSWindow::takeOverlayLayers()
+{
+    QVector<HwcOverlayLayer> layers = m_overlayLayers;
+    m_overlayLayers.clear();
+    return layers;
+}
+
+void QEglFSWindow::setVsyncDivisor(int divisor)
+{
+    m_vsyncDivisor = qBound(1, divisor, 8);
+}
+
+bool QEglFSWindow::takeUpdateSlot(qint64 vsync, qint64 period)
+{
+    // Half a period of slack, the vsync times come from a prediction
+    if (m_vsyncDivisor > 1 && vsync - m_lastUpdateVsync < m_vsyncDivisor * period - period / 2)
+        return false;
+
+    m_lastUpdateVsync = vsync;
+    return true;
+}
+
 QT_END_NAMESPACE
@@ -46,8 +46,11 @@
 #include "qeglfsscreen.h"
 
 #include "hwcomposer_context.h"
+#include "hwcomposer_overlay.h"
 
 #include <qpa/qplatformwindow.h>
+#include <QtGui/QRegion>
+#include <QtCore/QVector>
 
 QT_BEGIN_NAMESPACE
 
@@ -72,6 +75,23 @@ public:
 
     void requestUpdate();
 
+    // Region changed since the last swap, used for the hwc surface damage.
+    // Must be set from the thread that swaps the window's surface.
+    void setSwapDamage(const QRegion &damage) { m_swapDamage = damage; }
+    QRegion takeSwapDamage();
+
+    // Overlays for the next swap, same threading rules as the damage
+    void setOverlayLayers(const QVector<HwcOverlayLayer> &layers);
+    QVector<HwcOverlayLayer> takeOverlayLayers();
+
+    // Deliver update requests only every divisor-th vsync, capping the
+    // frame rate of the window. 1 means every vsync.
+    void setVsyncDivisor(int divisor);
+    int vsyncDivisor() const { return m_vsyncDivisor; }
+    // Whether an update may be delivered at the vsync at the given time,
+    // which then counts as the window's last update
+    bool takeUpdateSlot(qint64 vsync, qint64 period);
+
 protected:
     EGLSurface m_surface;
     EGLNativeWindowType m_window;
@@ -80,6 +100,10 @@ private:
     HwComposerContext *m_hwc;
     EGLConfig m_config;
     QSurfaceFormat m_format;
+    QRegion m_swapDamage;
+    QVector<HwcOverlayLayer> m_overlayLayers;
+    int m_vsyncDivisor;
+    qint64 m_lastUpdateVsync;
 };
 QT_END_NAMESPACE
 #endif // QEGLFSWINDOW_H
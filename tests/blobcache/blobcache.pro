@@ -0,0 +1,19 @@
+TEMPLATE = app
+TARGET = tst_blobcache
+
+CONFIG += testcase
+QT += testlib core-private
+
+HWC = $$PWD/../../hwcomposer
+INCLUDEPATH += $$HWC
+DEPENDPATH += $$HWC
+
+CONFIG += egl link_pkgconfig
+PKGCONFIG += android-headers libhardware hybris-egl-platform libsync
+
+SOURCES += tst_blobcache.cpp
+SOURCES += $$HWC/hwcomposer_blobcache.cpp \
+           $$HWC/hwcomposer_probecache.cpp
+
+# Avoid X11 header collision
+DEFINES += MESA_EGL_NO_X11_HEADERS
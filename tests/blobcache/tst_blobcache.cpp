@@ -0,0 +1,287 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <hwcomposer_blobcache.h>
+
+#include <QtTest/QtTest>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QFile>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QTemporaryDir>
+
+static const char *const FINGERPRINT = "Fake Vendor 1.0 build";
+
+// Uses the cache the way GLES drivers do: look the program up by the hash
+// of its source, asking for the size first, and compile and store it on a
+// miss.
+class FakeDriver
+{
+public:
+    explicit FakeDriver(HwComposerBlobCache *cache) : m_cache(cache) {}
+
+    QByteArray program(const QByteArray &source)
+    {
+        const QByteArray key = QCryptographicHash::hash(source, QCryptographicHash::Sha1);
+        qint64 size = m_cache->get(key.constData(), key.size(), NULL, 0);
+        if (size > 0) {
+            QByteArray binary(size, Qt::Uninitialized);
+            if (m_cache->get(key.constData(), key.size(), binary.data(), size) == size)
+                return binary;
+        }
+
+        compiles++;
+        const QByteArray binary = compile(source);
+        m_cache->set(key.constData(), key.size(), binary.constData(), binary.size());
+        return binary;
+    }
+
+    static QByteArray compile(const QByteArray &source)
+    {
+        // Big enough for the size limit to matter
+        return QByteArray("binary:") + source + QByteArray(1000, source.at(source.size() - 1));
+    }
+
+    int compiles = 0;
+
+private:
+    HwComposerBlobCache *m_cache;
+};
+
+static QByteArray shader(int i)
+{
+    return "void main() { gl_FragColor = vec4(" + QByteArray::number(i) + "); }";
+}
+
+class tst_BlobCache : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void storeAndReload();
+    void leastRecentlyUsedEviction();
+    void sizeLimit();
+    void smallerLimitOnReload();
+    void tornFile();
+    void otherFingerprint();
+    void notACache();
+
+private:
+    HwComposerBlobCache *createCache(int sizeKiB = 64, const QByteArray &fingerprint = FINGERPRINT);
+
+    QScopedPointer<QTemporaryDir> m_dir;
+    QString m_path;
+};
+
+void tst_BlobCache::init()
+{
+    m_dir.reset(new QTemporaryDir);
+    QVERIFY(m_dir->isValid());
+    m_path = m_dir->path() + QStringLiteral("/egl-blob-cache");
+}
+
+HwComposerBlobCache *tst_BlobCache::createCache(int sizeKiB, const QByteArray &fingerprint)
+{
+    qputenv("QPA_HWC_BLOB_CACHE_FILE", QFile::encodeName(m_path));
+    qputenv("QPA_HWC_BLOB_CACHE_SIZE", QByteArray::number(sizeKiB));
+    HwComposerBlobCache *cache = new HwComposerBlobCache;
+    if (!cache->open(fingerprint))
+        qWarning("blob cache turned off");
+    return cache;
+}
+
+void tst_BlobCache::storeAndReload()
+{
+    {
+        QScopedPointer<HwComposerBlobCache> cache(createCache());
+        FakeDriver driver(cache.data());
+        for (int i = 0; i < 10; i++)
+            QCOMPARE(driver.program(shader(i)), FakeDriver::compile(shader(i)));
+        QCOMPARE(driver.compiles, 10);
+
+        // Served from memory within the run
+        for (int i = 0; i < 10; i++)
+            driver.program(shader(i));
+        QCOMPARE(driver.compiles, 10);
+    }
+    QVERIFY(QFile::exists(m_path));
+
+    QScopedPointer<HwComposerBlobCache> cache(createCache());
+    FakeDriver driver(cache.data());
+    for (int i = 0; i < 10; i++)
+        QCOMPARE(driver.program(shader(i)), FakeDriver::compile(shader(i)));
+    QCOMPARE(driver.compiles, 0);
+}
+
+void tst_BlobCache::leastRecentlyUsedEviction()
+{
+    // Room for four programs
+    QScopedPointer<HwComposerBlobCache> cache(createCache(5));
+    FakeDriver driver(cache.data());
+    for (int i = 0; i < 4; i++)
+        driver.program(shader(i));
+    QCOMPARE(driver.compiles, 4);
+
+    // The first one was used again, the second one is the oldest now
+    driver.program(shader(0));
+    driver.program(shader(4));
+    QCOMPARE(driver.compiles, 5);
+
+    driver.compiles = 0;
+    driver.program(shader(0));
+    driver.program(shader(2));
+    driver.program(shader(3));
+    driver.program(shader(4));
+    QCOMPARE(driver.compiles, 0);
+    driver.program(shader(1));
+    QCOMPARE(driver.compiles, 1);
+}
+
+void tst_BlobCache::sizeLimit()
+{
+    {
+        QScopedPointer<HwComposerBlobCache> cache(createCache(5));
+        FakeDriver driver(cache.data());
+        for (int i = 0; i < 50; i++)
+            driver.program(shader(i));
+
+        // An entry taking more than a quarter of the cache isn't kept
+        const QByteArray key("huge");
+        const QByteArray value(2 * 1024, 'x');
+        cache->set(key.constData(), key.size(), value.constData(), value.size());
+        QCOMPARE(cache->get(key.constData(), key.size(), NULL, 0), qint64(0));
+    }
+    QVERIFY(QFileInfo(m_path).size() <= 5 * 1024 + 1024);
+
+    // Only the most recent ones made it
+    QScopedPointer<HwComposerBlobCache> cache(createCache(5));
+    FakeDriver driver(cache.data());
+    for (int i = 46; i < 50; i++)
+        driver.program(shader(i));
+    QCOMPARE(driver.compiles, 0);
+    driver.program(shader(45));
+    QCOMPARE(driver.compiles, 1);
+}
+
+void tst_BlobCache::smallerLimitOnReload()
+{
+    {
+        QScopedPointer<HwComposerBlobCache> cache(createCache());
+        FakeDriver driver(cache.data());
+        for (int i = 0; i < 8; i++)
+            driver.program(shader(i));
+    }
+
+    QScopedPointer<HwComposerBlobCache> cache(createCache(3));
+    FakeDriver driver(cache.data());
+    driver.program(shader(6));
+    driver.program(shader(7));
+    QCOMPARE(driver.compiles, 0);
+    driver.program(shader(5));
+    QCOMPARE(driver.compiles, 1);
+}
+
+void tst_BlobCache::tornFile()
+{
+    {
+        QScopedPointer<HwComposerBlobCache> cache(createCache());
+        FakeDriver driver(cache.data());
+        for (int i = 0; i < 4; i++)
+            driver.program(shader(i));
+    }
+
+    // Cut into the last, most recently used entry
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() - 10));
+    file.close();
+
+    {
+        QScopedPointer<HwComposerBlobCache> cache(createCache());
+        FakeDriver driver(cache.data());
+        for (int i = 0; i < 3; i++)
+            QCOMPARE(driver.program(shader(i)), FakeDriver::compile(shader(i)));
+        QCOMPARE(driver.compiles, 0);
+        QCOMPARE(driver.program(shader(3)), FakeDriver::compile(shader(3)));
+        QCOMPARE(driver.compiles, 1);
+    }
+
+    // and the file is whole again
+    QScopedPointer<HwComposerBlobCache> cache(createCache());
+    FakeDriver driver(cache.data());
+    for (int i = 0; i < 4; i++)
+        driver.program(shader(i));
+    QCOMPARE(driver.compiles, 0);
+}
+
+void tst_BlobCache::otherFingerprint()
+{
+    {
+        QScopedPointer<HwComposerBlobCache> cache(createCache());
+        FakeDriver driver(cache.data());
+        for (int i = 0; i < 4; i++)
+            driver.program(shader(i));
+    }
+
+    // A driver or build update, the binaries have to be compiled again
+    QScopedPointer<HwComposerBlobCache> cache(createCache(64, "Fake Vendor 1.0 other build"));
+    FakeDriver driver(cache.data());
+    for (int i = 0; i < 4; i++)
+        driver.program(shader(i));
+    QCOMPARE(driver.compiles, 4);
+}
+
+void tst_BlobCache::notACache()
+{
+    QFile file(m_path);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QVERIFY(file.write(QByteArray(4096, '\xff')) == 4096);
+    file.close();
+
+    QScopedPointer<HwComposerBlobCache> cache(createCache());
+    FakeDriver driver(cache.data());
+    driver.program(shader(0));
+    QCOMPARE(driver.compiles, 1);
+}
+
+QTEST_GUILESS_MAIN(tst_BlobCache)
+
+#include "tst_blobcache.moc"
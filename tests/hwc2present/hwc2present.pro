@@ -0,0 +1,32 @@
+TEMPLATE = app
+TARGET = tst_hwc2present
+
+CONFIG += testcase
+QT += testlib
+
+HWC = $$PWD/../../hwcomposer
+INCLUDEPATH += $$HWC
+DEPENDPATH += $$HWC
+
+DEFINES += HWC_PLUGIN_HAVE_HWCOMPOSER1_API HWC_PLUGIN_HAVE_HWCOMPOSER2_API
+
+CONFIG += link_pkgconfig
+PKGCONFIG += android-headers libhardware hybris-egl-platform hwcomposer-egl libsync
+
+# Headers only, the composer calls go to stubcomposer.cpp instead of libhwc2
+QMAKE_CXXFLAGS += $$system(pkg-config --cflags libhwc2)
+
+SOURCES += tst_hwc2present.cpp
+SOURCES += stubcomposer.cpp
+HEADERS += stubcomposer.h
+
+SOURCES += $$HWC/hwcomposer_window_v20.cpp \
+           $$HWC/hwcomposer_presentthread.cpp \
+           $$HWC/hwcomposer_fencemonitor.cpp \
+           $$HWC/hwcomposer_buffercount.cpp \
+           $$HWC/hwcomposer_framescheduler.cpp \
+           $$HWC/hwcomposer_vsynctimeline.cpp \
+           $$HWC/hwcomposer_startuptimeline.cpp
+
+# Avoid X11 header collision
+DEFINES += MESA_EGL_NO_X11_HEADERS
@@ -0,0 +1,98 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "stubcomposer.h"
+
+#include <hybris/hwc2/hwc2_compatibility_layer.h>
+
+#include <string.h>
+#include <unistd.h>
+
+StubComposer stubComposer;
+
+void resetStubComposer()
+{
+    memset(&stubComposer, 0, sizeof(stubComposer));
+}
+
+hwc2_error_t hwc2_compat_display_set_client_target(hwc2_compat_display_t *, uint32_t,
+                                                   struct ANativeWindowBuffer *,
+                                                   const int32_t acquireFenceFd,
+                                                   android_dataspace_t)
+{
+    stubComposer.setClientTarget++;
+    if (acquireFenceFd >= 0)
+        close(acquireFenceFd);
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_validate(hwc2_compat_display_t *,
+                                          uint32_t *outNumTypes, uint32_t *outNumRequests)
+{
+    stubComposer.validate++;
+    *outNumTypes = stubComposer.requestChanges ? 1 : 0;
+    *outNumRequests = 0;
+    return stubComposer.requestChanges ? HWC2_ERROR_HAS_CHANGES : HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_present_or_validate(hwc2_compat_display_t *,
+                                                     uint32_t *outNumTypes, uint32_t *outNumRequests,
+                                                     int32_t *outPresentFence, uint32_t *state)
+{
+    stubComposer.presentOrValidate++;
+    *outNumTypes = 0;
+    *outNumRequests = 0;
+    *outPresentFence = -1;
+    *state = stubComposer.refusePresentWithoutValidate ? 0 : 1;
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_accept_changes(hwc2_compat_display_t *)
+{
+    stubComposer.acceptChanges++;
+    return HWC2_ERROR_NONE;
+}
+
+hwc2_error_t hwc2_compat_display_present(hwc2_compat_display_t *, int32_t *outPresentFence)
+{
+    stubComposer.present++;
+    *outPresentFence = -1;
+    return HWC2_ERROR_NONE;
+}
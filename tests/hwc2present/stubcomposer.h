@@ -0,0 +1,70 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef STUBCOMPOSER_H
+#define STUBCOMPOSER_H
+
+// Stands in for libhwc2: counts the calls the HWC2 window makes per frame
+// and answers like a composer that is happy with the client target.
+struct StubComposer
+{
+    int setClientTarget;
+    int presentOrValidate;
+    int validate;
+    int acceptChanges;
+    int present;
+
+    // present_or_validate validates instead of presenting, as composers
+    // do when they want to look at the layers again
+    bool refusePresentWithoutValidate;
+    // validate asks for changes to the composition types
+    bool requestChanges;
+
+    int calls() const
+    {
+        return setClientTarget + presentOrValidate + validate + acceptChanges + present;
+    }
+};
+
+extern StubComposer stubComposer;
+
+void resetStubComposer();
+
+#endif // STUBCOMPOSER_H
@@ -0,0 +1,114 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "stubcomposer.h"
+
+#include <hwcomposer_window_v20.h>
+
+#include <QtTest/QtTest>
+
+// Runs on the device like the plugin: the native window allocates its
+// buffers through gralloc, only the composer is stubbed out.
+
+static const int WIDTH = 64;
+static const int HEIGHT = 64;
+static const int FRAMES = 100;
+
+class tst_Hwc2Present : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void callsPerFrame_data();
+    void callsPerFrame();
+};
+
+void tst_Hwc2Present::callsPerFrame_data()
+{
+    QTest::addColumn<QByteArray>("workarounds");
+    QTest::addColumn<bool>("refusePresentWithoutValidate");
+    QTest::addColumn<int>("expected");
+
+    // set_client_target + present_or_validate
+    QTest::newRow("skip validate") << QByteArray() << false << 2;
+    // set_client_target + present_or_validate, which validates, + present
+    QTest::newRow("composer validates") << QByteArray() << true << 3;
+    // set_client_target + validate + present
+    QTest::newRow("no-skip-validate") << QByteArray("no-skip-validate") << false << 3;
+}
+
+void tst_Hwc2Present::callsPerFrame()
+{
+    QFETCH(QByteArray, workarounds);
+    QFETCH(bool, refusePresentWithoutValidate);
+    QFETCH(int, expected);
+
+    qputenv("QPA_HWC_WORKAROUNDS", workarounds);
+    HWC2Window window(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888, nullptr, nullptr, nullptr);
+
+    ANativeWindowBuffer buffers[3];
+    for (int i = 0; i < 3; i++) {
+        buffers[i].width = WIDTH;
+        buffers[i].height = HEIGHT;
+        buffers[i].handle = reinterpret_cast<buffer_handle_t>(quintptr(i + 1));
+    }
+
+    // The first frame always validates, and imports all the buffers
+    resetStubComposer();
+    for (int i = 0; i < 3; i++)
+        QVERIFY(window.presentClientBuffer(&buffers[i], -1, nullptr, 0));
+    QCOMPARE(stubComposer.validate, 1);
+
+    resetStubComposer();
+    stubComposer.refusePresentWithoutValidate = refusePresentWithoutValidate;
+    for (int frame = 0; frame < FRAMES; frame++)
+        QVERIFY(window.presentClientBuffer(&buffers[frame % 3], -1, nullptr, 0));
+
+    QCOMPARE(stubComposer.setClientTarget, FRAMES);
+    QCOMPARE(stubComposer.acceptChanges, 0);
+
+    const qreal callsPerFrame = qreal(stubComposer.calls()) / FRAMES;
+    QTest::setBenchmarkResult(callsPerFrame, QTest::Events);
+    QCOMPARE(callsPerFrame, qreal(expected));
+}
+
+QTEST_GUILESS_MAIN(tst_Hwc2Present)
+
+#include "tst_hwc2present.moc"
@@ -0,0 +1,10 @@
+TEMPLATE = subdirs
+SUBDIRS = blobcache vsyncnotifier
+
+# Same check as for building the HWC2 backend of the plugin
+QMAKE_CONFIG_TESTS_DIR = $$PWD/../hwcomposer/config.tests
+load(configure)
+
+qtCompileTest(hwcomposer2) {
+    SUBDIRS += hwc2present
+}
@@ -0,0 +1,179 @@
+/****************************************************************************
+**
+** Copyright (C) 2026 Jolla Ltd.
+**
+** This file is part of the hwcomposer plugin.
+**
+** $QT_BEGIN_LICENSE:LGPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and Digia.  For licensing terms and
+** conditions see http://qt.digia.com/licensing.  For further information
+** use the contact form at http://qt.digia.com/contact-us.
+**
+** GNU Lesser General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU Lesser
+** General Public License version 2.1 as published by the Free Software
+** Foundation and appearing in the file LICENSE.LGPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU Lesser General Public License version 2.1 requirements
+** will be met: http://www.gnu.org/licenses/old-licenses/lgpl-2.1.html.
+**
+** In addition, as a special exception, Digia gives you certain additional
+** rights.  These rights are described in the Digia Qt LGPL Exception
+** version 1.1, included in the file LGPL_EXCEPTION.txt in this package.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3.0 as published by the Free Software
+** Foundation and appearing in the file LICENSE.GPL included in the
+** packaging of this file.  Please review the following information to
+** ensure the GNU General Public License version 3.0 requirements will be
+** met: http://www.gnu.org/copyleft/gpl.html.
+**
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include <hwcomposer_vsyncnotifier.h>
+
+#include <QtTest/QtTest>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include <algorithm>
+#include <time.h>
+
+static qint64 now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static void busyWait(qint64 ns)
+{
+    const qint64 end = now() + ns;
+    while (now() < end)
+        ;
+}
+
+// Plays the hwc callback thread, notifying at a fixed vsync period
+class VsyncThread : public QThread
+{
+public:
+    VsyncThread(HwComposerVsyncNotifier *notifier, int count, qint64 periodNs)
+        : m_notifier(notifier), m_count(count), m_periodNs(periodNs) {}
+
+    qint64 lastTimestamp = 0;
+
+protected:
+    void run() Q_DECL_OVERRIDE
+    {
+        qint64 next = now();
+        for (int i = 0; i < m_count; i++) {
+            next += m_periodNs;
+            struct timespec ts = { time_t(next / 1000000000LL), long(next % 1000000000LL) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            lastTimestamp = now();
+            m_notifier->notify(lastTimestamp);
+        }
+    }
+
+private:
+    HwComposerVsyncNotifier *m_notifier;
+    int m_count;
+    qint64 m_periodNs;
+};
+
+class Receiver : public HwComposerVsyncNotifier::Listener
+{
+public:
+    void vsyncReceived(qint64 timestamp) Q_DECL_OVERRIDE
+    {
+        latencies.append(now() - timestamp);
+        lastTimestamp = timestamp;
+    }
+
+    QVector<qint64> latencies;
+    qint64 lastTimestamp = 0;
+};
+
+class tst_VsyncNotifier : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void coalesce();
+    void latency_data();
+    void latency();
+};
+
+void tst_VsyncNotifier::coalesce()
+{
+    Receiver receiver;
+    HwComposerVsyncNotifier notifier(&receiver);
+
+    // A busy receiver gets one wakeup carrying the latest vsync
+    for (qint64 timestamp = 1; timestamp <= 5; timestamp++)
+        notifier.notify(timestamp);
+    QTRY_COMPARE(receiver.latencies.size(), 1);
+    QCOMPARE(receiver.lastTimestamp, qint64(5));
+
+    // and the next vsync wakes it up again
+    notifier.notify(6);
+    QTRY_COMPARE(receiver.latencies.size(), 2);
+    QCOMPARE(receiver.lastTimestamp, qint64(6));
+}
+
+void tst_VsyncNotifier::latency_data()
+{
+    QTest::addColumn<int>("loadUs");
+
+    QTest::newRow("idle") << 0;
+    // GUI thread busy in slices shorter than a frame
+    QTest::newRow("loaded") << 4000;
+    // GUI thread stalling past the vsync period
+    QTest::newRow("stalled") << 20000;
+}
+
+void tst_VsyncNotifier::latency()
+{
+    QFETCH(int, loadUs);
+
+    const int vsyncs = 120;
+    const qint64 periodNs = 16666667;
+
+    Receiver receiver;
+    HwComposerVsyncNotifier notifier(&receiver);
+
+    QTimer load;
+    load.setInterval(0);
+    connect(&load, &QTimer::timeout, [loadUs]() { busyWait(qint64(loadUs) * 1000); });
+    if (loadUs)
+        load.start();
+
+    VsyncThread thread(&notifier, vsyncs, periodNs);
+    thread.start();
+    QTRY_VERIFY_WITH_TIMEOUT(thread.isFinished(), 5000);
+    load.stop();
+
+    // The last vsync is never lost
+    QTRY_COMPARE(receiver.lastTimestamp, thread.lastTimestamp);
+    QVERIFY(receiver.latencies.size() <= vsyncs);
+
+    QVector<qint64> latencies = receiver.latencies;
+    std::sort(latencies.begin(), latencies.end());
+    const qint64 median = latencies.at(latencies.size() / 2);
+    qDebug("%d vsyncs delivered in %d wakeups, latency median %.3f ms, max %.3f ms",
+           vsyncs, latencies.size(), median / 1000000.0, latencies.last() / 1000000.0);
+
+    QTest::setBenchmarkResult(median / 1000000.0, QTest::WalltimeMilliseconds);
+}
+
+QTEST_GUILESS_MAIN(tst_VsyncNotifier)
+
+#include "tst_vsyncnotifier.moc"
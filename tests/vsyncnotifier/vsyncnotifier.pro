@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = tst_vsyncnotifier
+
+CONFIG += testcase
+QT += testlib
+QT -= gui
+
+HWC = $$PWD/../../hwcomposer
+INCLUDEPATH += $$HWC
+DEPENDPATH += $$HWC
+
+SOURCES += tst_vsyncnotifier.cpp
+SOURCES += $$HWC/hwcomposer_vsyncnotifier.cpp